@@ -5,12 +5,14 @@
 #define luaall_c
 
 #include "lapi.c"
+#include "lclone.c"
 #include "lcode.c"
 #include "ldebug.c"
 #include "ldo.c"
 #include "ldump.c"
 #include "lfunc.c"
 #include "lgc.c"
+#include "ljit.c"
 #include "llex.c"
 #include "lmem.c"
 #include "lobject.c"
@@ -0,0 +1,126 @@
+/*
+* clonetest.c -- checks of lua_clonestate
+* A template state is cloned and the clone must not reach what the
+* template owns: files it opened, its compiled patterns, the blocks of
+* its userdata. Build with -fsanitize=address to also catch reads of
+* freed memory and double closes.
+* usage: clonetest
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+static int failures = 0;
+
+static void check (int ok, const char *what) {
+  printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+  if (!ok) failures++;
+}
+
+static int run (lua_State *L, const char *code) {
+  if (luaL_dostring(L, code) != 0) {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    lua_pop(L, 1);
+    return 0;
+  }
+  return 1;
+}
+
+/* clones `T', which must fail with `msg' (when not NULL) */
+static lua_State *clone (lua_State *T, const char *msg) {
+  lua_State *L = luaL_clonestate(T);
+  const char *what = msg ? msg : "clone";
+  if (L == NULL) {
+    if (msg == NULL || strstr(lua_tostring(T, -1), msg) == NULL)
+      fprintf(stderr, "%s\n", lua_tostring(T, -1));
+    else
+      msg = NULL;
+    lua_pop(T, 1);
+  }
+  check(msg == NULL, what);
+  return L;
+}
+
+static int counter_clone (lua_State *L) {
+  int *n = (int *)lua_touserdata(L, 1);
+  *n = -*n;
+  return 0;
+}
+
+/* a counter whose blocks the clone may copy (with `counter_clone') */
+static void newcounter (lua_State *L, int withhook) {
+  *(int *)lua_newuserdata(L, sizeof(int)) = 42;
+  lua_newtable(L);
+  if (withhook) {
+    lua_pushcfunction(L, counter_clone);
+    lua_setfield(L, -2, "__clone");
+  }
+  lua_setmetatable(L, -2);
+  lua_setglobal(L, "counter");
+}
+
+static void files (void) {
+  lua_State *T = luaL_newstate();
+  lua_State *L;
+  luaL_openlibs(T);
+  run(T, "f = assert(io.tmpfile()); f:write('template')");
+  L = clone(T, "cannot clone an open file");
+  if (L) lua_close(L);
+  check(run(T, "f:seek('set'); assert(f:read('*a') == 'template')"),
+        "template file still usable");
+  run(T, "f:close()");
+  L = clone(T, NULL);
+  if (L) {
+    check(run(L, "assert(not pcall(f.close, f))"), "clone sees a closed file");
+    check(run(L, "assert(not io.stdout:close())"),
+          "clone cannot close a standard file");
+    lua_close(L);
+  }
+  check(run(T, "assert(io.stdout:write(''))"), "template keeps stdout");
+  lua_close(T);
+}
+
+static void patterns (void) {
+  lua_State *T = luaL_newstate();
+  lua_State *L;
+  luaL_openlibs(T);
+  run(T, "assert(('xxaab'):find('a+b') == 3)");
+  L = clone(T, NULL);
+  lua_close(T);
+  if (L) {
+    check(run(L, "assert(('xxaab'):find('a+b') == 3)"),
+          "clone compiles its own patterns");
+    lua_close(L);
+  }
+}
+
+static void userdata (void) {
+  lua_State *T = luaL_newstate();
+  lua_State *L;
+  luaL_openlibs(T);
+  newcounter(T, 0);
+  L = clone(T, "__clone");
+  if (L) lua_close(L);
+  newcounter(T, 1);
+  L = clone(T, NULL);
+  if (L) {
+    lua_getglobal(L, "counter");
+    check(*(int *)lua_touserdata(L, -1) == -42, "__clone fixes the copy");
+    lua_close(L);
+  }
+  lua_getglobal(T, "counter");
+  check(*(int *)lua_touserdata(T, -1) == 42, "template block unchanged");
+  lua_close(T);
+}
+
+int main (void) {
+  files();
+  patterns();
+  userdata();
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
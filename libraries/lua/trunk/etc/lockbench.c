@@ -0,0 +1,190 @@
+/*
+* lockbench.c -- stress test and benchmark for LUA_USE_LOCK
+* Several OS threads run the same Lua function, each on its own Lua
+* thread of one shared state, and the results are checked. Then one
+* thread loops with a stack the collector shrinks while another allocates.
+* Build Lua with -DLUA_USE_LOCK to run more than one OS thread; build
+* it without to get the no-lock baseline (one OS thread).
+* usage: lockbench [threads] [iterations]
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+/*
+** each iteration allocates (so all threads drive the collector), runs a
+** coroutine now and then, and counts itself in the global `done', which
+** must end exact: straight code (no jumps nor calls) is never interrupted
+*/
+static const char work[] =
+  "local n = ...\n"
+  "local s = 0\n"
+  "for i = 1, n do\n"
+  "  local t = {i, tostring(i), {x = i}}\n"
+  "  s = s + t[1] + #t[2] + t[3].x\n"
+  "  done = done + 1\n"
+  "  if i % 100 == 0 then\n"
+  "    s = s + coroutine.wrap(function (a) return coroutine.yield(a) end)(1) - 1\n"
+  "  end\n"
+  "end\n"
+  "return s\n";
+
+/*
+** one thread grows its stack deep once and then loops, while another
+** allocates: the collector (run by the second) shrinks the stack of the
+** first, which must not keep pointers into it across a lock handover
+*/
+static const char deep[] =
+  "local n = ...\n"
+  "local function rec (d)\n"
+  "  if d == 0 then return 0 end\n"
+  "  return rec(d - 1) + 1\n"
+  "end\n"
+  "local s = rec(3000)\n"
+  "for i = 1, n do s = s + i % 7 end\n"
+  "return s\n";
+
+static const char alloc[] =
+  "local n = ...\n"
+  "local s = 0\n"
+  "for i = 1, n do local t = {i % 7} s = s + t[1] end\n"
+  "return s\n";
+
+typedef struct Job {
+  lua_State *L;
+  int n;
+  double expected;
+  int status;
+} Job;
+
+
+static void *run (void *ud) {
+  Job *job = (Job *)ud;
+  lua_pushinteger(job->L, job->n);
+  job->status = lua_pcall(job->L, 1, 1, 0);
+  return NULL;
+}
+
+
+static double now (void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+static double mod7sum (int n) {  /* sum of i % 7 for i = 1, n */
+  double s = 0;
+  int i;
+  for (i = 1; i <= n; i++) s += i % 7;
+  return s;
+}
+
+
+/* runs `code' in a new thread of `L' (anchored in its stack) */
+static void newjob (lua_State *L, Job *job, const char *code, size_t len,
+                    int n, double expected) {
+  job->L = lua_newthread(L);
+  job->n = n;
+  job->expected = expected;
+  if (luaL_loadbuffer(job->L, code, len, "=lockbench") != 0) {
+    fprintf(stderr, "%s\n", lua_tostring(job->L, -1));
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+/* runs the jobs, one OS thread each; returns the time taken */
+static double runjobs (Job *jobs, int njobs) {
+  pthread_t *threads = (pthread_t *)malloc(njobs * sizeof(pthread_t));
+  double t0 = now();
+  int i;
+  for (i = 0; i < njobs; i++)
+    pthread_create(&threads[i], NULL, run, &jobs[i]);
+  for (i = 0; i < njobs; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+  return now() - t0;
+}
+
+
+/*
+** called after all OS threads are joined: the stack of a job may move
+** (by the collector of another job) until then, and `lua_tonumber' does
+** not take the lock
+*/
+static int checkjobs (Job *jobs, int njobs) {
+  int i, ok = 1;
+  for (i = 0; i < njobs; i++) {
+    if (jobs[i].status != 0) {
+      printf("thread %d: %s\n", i, lua_tostring(jobs[i].L, -1));
+      ok = 0;
+    }
+    else if (lua_tonumber(jobs[i].L, -1) != jobs[i].expected) {
+      printf("thread %d: got %.14g, expected %.14g\n", i,
+             lua_tonumber(jobs[i].L, -1), jobs[i].expected);
+      ok = 0;
+    }
+  }
+  return ok;
+}
+
+
+int main (int argc, char *argv[]) {
+  int nthreads = (argc > 1) ? atoi(argv[1]) : 4;
+  int n = (argc > 2) ? atoi(argv[2]) : 200000;
+  lua_State *L = luaL_newstate();
+  Job *jobs;
+  double expected = 0, t;
+  int i, ok;
+#if !defined(LUA_USE_LOCK)
+  if (nthreads > 1) {
+    fprintf(stderr, "no LUA_USE_LOCK: running 1 thread\n");
+    nthreads = 1;
+  }
+#endif
+  if (nthreads < 1 || n < 1) {
+    fprintf(stderr, "usage: %s [threads] [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  luaL_openlibs(L);
+  lua_pushinteger(L, 0);
+  lua_setglobal(L, "done");
+  for (i = 1; i <= n; i++) {
+    char buff[32];
+    expected += 2.0 * i + sprintf(buff, "%d", i);
+  }
+  jobs = (Job *)malloc(nthreads * sizeof(Job));
+  for (i = 0; i < nthreads; i++)
+    newjob(L, &jobs[i], work, sizeof(work) - 1, n, expected);
+  t = runjobs(jobs, nthreads);
+  ok = checkjobs(jobs, nthreads);
+  lua_getglobal(L, "done");
+  if (lua_tointeger(L, -1) != (lua_Integer)nthreads * n) {
+    printf("done = %ld, expected %ld\n", (long)lua_tointeger(L, -1),
+           (long)nthreads * n);
+    ok = 0;
+  }
+  printf("%s: %d thread(s) x %d iterations in %.3f s (%.0f iterations/s)\n",
+         ok ? "ok" : "FAILED", nthreads, n, t, nthreads * n / t);
+  lua_settop(L, 0);
+  if (nthreads > 1) {  /* stack shrunk under a looping thread */
+    int okdeep;
+    newjob(L, &jobs[0], deep, sizeof(deep) - 1, n, 3000 + mod7sum(n));
+    newjob(L, &jobs[1], alloc, sizeof(alloc) - 1, n, mod7sum(n));
+    t = runjobs(jobs, 2);
+    okdeep = checkjobs(jobs, 2);
+    printf("%s: deep stack and allocation, 2 threads x %d iterations "
+           "in %.3f s\n", okdeep ? "ok" : "FAILED", n, t);
+    ok = ok && okdeep;
+  }
+  lua_close(L);
+  free(jobs);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -107,6 +107,31 @@ LUA_API int lua_checkstack (lua_State *L, int size) {
 }
 
 
+/*
+** Grows the stack of `L' to hold `slots' values and `calls' nested calls
+** and keeps the collector from shrinking it below that, so that running
+** up to that depth does not reallocate the stack. Returns 0 if that is
+** over the limits of a stack.
+*/
+LUA_API int lua_reservestack (lua_State *L, int slots, int calls) {
+  int res = 1;
+  lua_lock(L);
+  if (slots > LUAI_MAXCSTACK || calls >= LUAI_MAXCALLS)
+    res = 0;  /* stack overflow */
+  else {
+    int size = slots + 1 + EXTRA_STACK;  /* as in `luaD_reallocstack' */
+    if (L->stacksize < size)
+      luaD_reallocstack(L, slots);
+    if (L->size_ci < calls + 1)
+      luaD_reallocCI(L, calls + 1);
+    if (L->minstack < size) L->minstack = size;
+    if (L->minci < calls + 1) L->minci = calls + 1;
+  }
+  lua_unlock(L);
+  return res;
+}
+
+
 LUA_API void lua_xmove (lua_State *from, lua_State *to, int n) {
   int i;
   if (from == to) return;
@@ -137,6 +162,26 @@ LUA_API lua_CFunction lua_atpanic (lua_State *L, lua_CFunction panicf) {
 }
 
 
+/*
+** New threads start with room for `slots' values and `calls' nested
+** calls (at least the default sizes), and take the stacks of dead
+** threads kept in a pool of up to `n' stacks. Returns the previous `n'.
+*/
+LUA_API int lua_stackpool (lua_State *L, int n, int slots, int calls) {
+  int old;
+  lua_lock(L);
+  old = G(L)->maxspare;
+  api_check(L, n >= 0);
+  slots = (slots < BASIC_STACK_SIZE) ? BASIC_STACK_SIZE :
+          (slots > LUAI_MAXCSTACK) ? LUAI_MAXCSTACK : slots;
+  calls = (calls < BASIC_CI_SIZE) ? BASIC_CI_SIZE :
+          (calls >= LUAI_MAXCALLS) ? LUAI_MAXCALLS - 1 : calls;
+  luaE_setstackpool(L, n, slots + EXTRA_STACK, calls);
+  lua_unlock(L);
+  return old;
+}
+
+
 LUA_API lua_State *lua_newthread (lua_State *L) {
   lua_State *L1;
   lua_lock(L);
@@ -323,7 +368,9 @@ LUA_API lua_Number lua_tonumber (lua_State *L, int idx) {
 LUA_API lua_Integer lua_tointeger (lua_State *L, int idx) {
   TValue n;
   const TValue *o = index2adr(L, idx);
-  if (tonumber(o, &n)) {
+  if (ttisint(o))
+    return ivalue(o);
+  else if (tonumber(o, &n)) {
     lua_Integer res;
     lua_Number num = nvalue(o);
     lua_number2integer(res, num);
@@ -436,7 +483,7 @@ LUA_API void lua_pushnumber (lua_State *L, lua_Number n) {
 
 LUA_API void lua_pushinteger (lua_State *L, lua_Integer n) {
   lua_lock(L);
-  setnvalue(L->top, cast_num(n));
+  setivalue(L->top, n);
   api_incr_top(L);
   lua_unlock(L);
 }
@@ -451,6 +498,27 @@ LUA_API void lua_pushlstring (lua_State *L, const char *s, size_t len) {
 }
 
 
+/*
+** Pushes a string that uses the memory at `s' (which must have a '\0'
+** at `s[len]') instead of a copy. When the string is collected, Lua
+** calls `freefn(ud, s, len)' (if `freefn' is not NULL). Short strings
+** are copied and released at once. `s' always passes to Lua: if there
+** is a memory error, `freefn' is called before the error is raised.
+*/
+LUA_API const char *lua_pushexternalstring (lua_State *L, const char *s,
+                                   size_t len, lua_ExtFree freefn, void *ud) {
+  TString *ts;
+  lua_lock(L);
+  api_check(L, s[len] == '\0');
+  ts = luaS_newextstr(L, s, len, freefn, ud);
+  setsvalue2s(L, L->top, ts);
+  api_incr_top(L);
+  luaC_checkGC(L);  /* (only now: `s' belongs to Lua) */
+  lua_unlock(L);
+  return getstr(ts);
+}
+
+
 LUA_API void lua_pushstring (lua_State *L, const char *s) {
   if (s == NULL)
     lua_pushnil(L);
@@ -694,6 +762,48 @@ LUA_API void lua_rawseti (lua_State *L, int idx, int n) {
 }
 
 
+/*
+** Pops `n' values and stores them, without metamethods, in the table at
+** `idx' (which must not be one of them) as t[first], ..., t[first+n-1].
+** The array part grows at most once to hold them.
+*/
+LUA_API void lua_rawsetarray (lua_State *L, int idx, int first, int n) {
+  StkId o;
+  Table *t;
+  int i;
+  lua_lock(L);
+  api_checknelems(L, n);
+  o = index2adr(L, idx);
+  api_check(L, ttistable(o));
+  t = hvalue(o);
+  if (first >= 1 && first - 1 <= t->sizearray && first - 1 + n > t->sizearray)
+    luaH_resizearray(L, t, first - 1 + n);
+  for (i = 0; i < n; i++) {
+    TValue *v = L->top - n + i;
+    setobj2t(L, luaH_setnum(L, t, first + i), v);
+    luaC_barriert(L, t, v);
+  }
+  L->top -= n;
+  lua_unlock(L);
+}
+
+
+/*
+** Resizes the table at `idx' to have room for `narr' elements in its
+** array part and `nhash' in its hash part. Elements that do not fit
+** are moved to the other part, which may then grow again.
+*/
+LUA_API void lua_tableresize (lua_State *L, int idx, int narr, int nhash) {
+  StkId o;
+  lua_lock(L);
+  api_check(L, narr >= 0 && nhash >= 0);
+  o = index2adr(L, idx);
+  api_check(L, ttistable(o));
+  luaH_resize(L, hvalue(o), narr, nhash);
+  lua_unlock(L);
+}
+
+
 LUA_API int lua_setmetatable (lua_State *L, int objindex) {
   TValue *obj;
   Table *mt;
@@ -929,6 +1039,11 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
         g->GCthreshold = g->totalbytes - a;
       else
         g->GCthreshold = 0;
+      if (isgenerational(g)) {  /* each step is a whole (minor) cycle */
+        luaC_step(L);
+        res = 1;
+        break;
+      }
       while (g->GCthreshold <= g->totalbytes) {
         luaC_step(L);
         if (g->gcstate == GCSpause) {  /* end of cycle? */
@@ -938,6 +1053,14 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       }
       break;
     }
+    case LUA_GCSTEPTIME: {  /* `data' is a time budget in microseconds */
+      res = luaC_steptime(L, cast_num(data) / 1000000);
+      break;
+    }
+    case LUA_GCBGSWEEP: {  /* return previous setting (-1 if unavailable) */
+      res = luaM_setbgfree(L, data);
+      break;
+    }
     case LUA_GCSETPAUSE: {
       res = g->gcpause;
       g->gcpause = data;
@@ -948,6 +1071,12 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       g->gcstepmul = data;
       break;
     }
+    case LUA_GCGEN:
+    case LUA_GCINC: {  /* return previous mode */
+      res = isgenerational(g) ? LUA_GCGEN : LUA_GCINC;
+      luaC_changemode(L, (what == LUA_GCGEN) ? KGC_GEN : KGC_NORMAL);
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
@@ -955,6 +1084,41 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
 }
 
 
+LUA_API void lua_gcstats (lua_State *L, lua_GCStats *s) {
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  *s = g->gcstats;
+  s->threshold = g->GCthreshold;
+  s->estimate = g->estimate;
+  lua_unlock(L);
+}
+
+
+/*
+** Histogram of the chains of the string table: `hist[i]' gets the number
+** of chains with `i' strings (`hist[n-1]', with `n-1' or more strings).
+** Returns the size of the table.
+*/
+LUA_API int lua_strtabstats (lua_State *L, unsigned long *hist, int n) {
+  stringtable *tb;
+  int i, size;
+  lua_lock(L);
+  tb = &G(L)->strt;
+  size = tb->size;
+  for (i = 0; i < n; i++) hist[i] = 0;
+  for (i = 0; n > 0 && i < size; i++) {
+    GCObject *o;
+    int len = 0;
+    for (o = tb->hash[i]; o != NULL && len < n - 1; o = o->gch.next)
+      len++;
+    hist[len]++;
+  }
+  lua_unlock(L);
+  return size;
+}
+
+
 
 /*
 ** miscellaneous functions
@@ -1016,12 +1180,59 @@ LUA_API lua_Alloc lua_getallocf (lua_State *L, void **ud) {
 
 LUA_API void lua_setallocf (lua_State *L, lua_Alloc f, void *ud) {
   lua_lock(L);
+  luaM_setbgfree(L, 0);  /* new allocator is not known to be thread safe */
+  G(L)->allocsafe = 0;
   G(L)->ud = ud;
   G(L)->frealloc = f;
   lua_unlock(L);
 }
 
 
+/*
+** With `bulk' set, `lua_close' does not free objects one by one: it only
+** runs pending finalizers and then frees the state block, so the allocator
+** must release all memory of the state when that block is freed.
+*/
+LUA_API void lua_setbulkfree (lua_State *L, int bulk) {
+  lua_lock(L);
+  G(L)->bulkfree = cast_byte(bulk != 0);
+  lua_unlock(L);
+}
+
+
+/*
+** Declares that the allocator of the state may be called from other
+** threads at the same time as from the thread running Lua (as needed by
+** background freeing, see LUA_GCBGSWEEP). `lua_newstate' and
+** `lua_setallocf' clear it.
+*/
+LUA_API void lua_setallocsafe (lua_State *L, int safe) {
+  lua_lock(L);
+  if (!safe) luaM_setbgfree(L, 0);
+  G(L)->allocsafe = cast_byte(safe != 0);
+  lua_unlock(L);
+}
+
+
+/*
+** Functions called more than `threshold' times are compiled to native
+** code; a negative `threshold' stops running native code. Returns the
+** previous threshold, or -1 if it was off or there is no JIT.
+*/
+LUA_API int lua_setjit (lua_State *L, int threshold) {
+  int old = -1;
+  lua_lock(L);
+#if defined(LUA_USE_JIT)
+  old = G(L)->jitthreshold;
+  G(L)->jitthreshold = (threshold < 0) ? -1 : threshold;
+#else
+  UNUSED(L); UNUSED(threshold);
+#endif
+  lua_unlock(L);
+  return old;
+}
+
+
 LUA_API void *lua_newuserdata (lua_State *L, size_t size) {
   Udata *u;
   lua_lock(L);
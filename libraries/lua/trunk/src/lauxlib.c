@@ -389,6 +389,137 @@ LUALIB_API const char *luaL_findtable (lua_State *L, int idx,
 */
 
 
+#if defined(LUAL_BUFFERGROW)
+
+/*
+** A buffer starts in its own `buffer'. When that fills, the contents
+** move to a block kept by a box: a userdata in the stack that frees the
+** block when collected, so the block does not leak if there is an error
+** while the buffer is in use. The block then doubles each time it fills.
+*/
+
+#define bufflen(B)	((size_t)((B)->p - (B)->b))
+#define bufffree(B)	((B)->size - bufflen(B))
+
+
+typedef struct UBox {
+  void *box;
+  size_t bsize;
+} UBox;
+
+
+static void *resizebox (lua_State *L, int idx, size_t newsize) {
+  void *ud;
+  lua_Alloc allocf = lua_getallocf(L, &ud);
+  UBox *box = (UBox *)lua_touserdata(L, idx);
+  void *temp = (*allocf)(ud, box->box, box->bsize, newsize);
+  if (temp == NULL && newsize > 0)  /* allocation error? */
+    luaL_error(L, "not enough memory for buffer");
+  box->box = temp;
+  box->bsize = newsize;
+  return temp;
+}
+
+
+static int boxgc (lua_State *L) {
+  resizebox(L, 1, 0);
+  return 0;
+}
+
+
+static void newbox (lua_State *L) {
+  UBox *box = (UBox *)lua_newuserdata(L, sizeof(UBox));
+  box->box = NULL;
+  box->bsize = 0;
+  if (luaL_newmetatable(L, "_UBOX*")) {  /* creating metatable? */
+    lua_pushcfunction(L, boxgc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+}
+
+
+/* makes room for `sz' more chars; a box is (or goes) at `boxidx' */
+static char *growbuffer (luaL_Buffer *B, size_t sz, int boxidx) {
+  lua_State *L = B->L;
+  size_t len = bufflen(B);
+  size_t newsize = B->size * 2;
+  if (~(size_t)0 - sz < len)
+    luaL_error(L, "buffer too large");
+  if (newsize < len + sz)  /* (also if doubling overflowed) */
+    newsize = len + sz;
+  if (B->lvl == 0) {  /* contents still in `buffer'? */
+    newbox(L);
+    if (boxidx != -1)
+      lua_insert(L, boxidx);  /* put box below the values above it */
+    B->b = (char *)memcpy(resizebox(L, boxidx, newsize), B->buffer, len);
+    B->lvl = 1;
+  }
+  else
+    B->b = (char *)resizebox(L, boxidx, newsize);
+  B->p = B->b + len;
+  B->size = newsize;
+  return B->p;
+}
+
+
+LUALIB_API char *luaL_prepbuffsize (luaL_Buffer *B, size_t sz) {
+  if (bufffree(B) < sz)
+    return growbuffer(B, sz, -1);
+  return B->p;
+}
+
+
+LUALIB_API char *luaL_prepbuffer (luaL_Buffer *B) {
+  return luaL_prepbuffsize(B, LUAL_BUFFERSIZE);
+}
+
+
+LUALIB_API void luaL_addlstring (luaL_Buffer *B, const char *s, size_t l) {
+  if (l > 0) {
+    memcpy(luaL_prepbuffsize(B, l), s, l);
+    B->p += l;
+  }
+}
+
+
+LUALIB_API void luaL_addstring (luaL_Buffer *B, const char *s) {
+  luaL_addlstring(B, s, strlen(s));
+}
+
+
+LUALIB_API void luaL_pushresult (luaL_Buffer *B) {
+  lua_State *L = B->L;
+  lua_pushlstring(L, B->b, bufflen(B));
+  if (B->lvl) {  /* is there a box? */
+    resizebox(L, -2, 0);  /* free its block now */
+    lua_remove(L, -2);
+  }
+  B->lvl = 1;
+}
+
+
+LUALIB_API void luaL_addvalue (luaL_Buffer *B) {
+  lua_State *L = B->L;
+  size_t vl;
+  const char *s = lua_tolstring(L, -1, &vl);
+  if (bufffree(B) < vl)
+    growbuffer(B, vl, -2);  /* (value stays on top) */
+  memcpy(B->p, s, vl);
+  B->p += vl;
+  lua_pop(L, 1);  /* remove from stack */
+}
+
+
+LUALIB_API void luaL_buffinit (lua_State *L, luaL_Buffer *B) {
+  B->L = L;
+  B->p = B->b = B->buffer;
+  B->size = LUAL_BUFFERSIZE;
+  B->lvl = 0;
+}
+
+#else
+
 #define bufflen(B)	((B)->p - (B)->buffer)
 #define bufffree(B)	((size_t)(LUAL_BUFFERSIZE - bufflen(B)))
 
@@ -475,6 +606,8 @@ LUALIB_API void luaL_buffinit (lua_State *L, luaL_Buffer *B) {
   B->lvl = 0;
 }
 
+#endif
+
 /* }====================================================== */
 
 
@@ -646,7 +779,247 @@ static int panic (lua_State *L) {
 
 LUALIB_API lua_State *luaL_newstate (void) {
   lua_State *L = lua_newstate(l_alloc, NULL);
-  if (L) lua_atpanic(L, &panic);
+  if (L) {
+    lua_atpanic(L, &panic);
+    lua_setallocsafe(L, 1);  /* `realloc' and `free' are thread safe */
+  }
+  return L;
+}
+
+
+LUALIB_API lua_State *luaL_clonestate (lua_State *L) {
+  lua_State *L1 = lua_clonestate(L, l_alloc, NULL);
+  if (L1) {
+    lua_atpanic(L1, &panic);
+    lua_setallocsafe(L1, 1);
+  }
+  return L1;
+}
+
+
+
+/*
+** {======================================================
+** Pooled allocator
+** =======================================================
+*/
+
+/*
+** Blocks up to LUAL_POOLMAXSIZE bytes are rounded to a multiple of the
+** maximum alignment and kept in one free list per size class. Lua always
+** passes the exact old size of a block, so small blocks need no header.
+** Larger blocks are linked in a list, so that freeing the state block
+** (the last thing `lua_close' does) releases all memory of the pool.
+*/
+
+typedef LUAI_USER_ALIGNMENT_T PoolAlign;
+
+#define POOLGRAIN	sizeof(PoolAlign)
+#define POOLCLASSES	((int)((LUAL_POOLMAXSIZE + POOLGRAIN - 1) / POOLGRAIN))
+
+#define poolclass(sz)	((int)(((sz) - 1) / POOLGRAIN))
+#define classsize(c)	(((size_t)(c) + 1) * POOLGRAIN)
+#define inpool(sz)	((sz) <= LUAL_POOLMAXSIZE)
+
+
+typedef union PoolBlock {
+  union PoolBlock *next;  /* next free block of the same class */
+  PoolAlign dummy;
+} PoolBlock;
+
+
+typedef union PoolChunk {
+  union PoolChunk *next;  /* next slab */
+  PoolAlign dummy;  /* ensures maximum alignment for the blocks */
+} PoolChunk;
+
+
+typedef union PoolLarge {
+  struct {
+    union PoolLarge *prev;
+    union PoolLarge *next;
+  } l;
+  PoolAlign dummy;
+} PoolLarge;
+
+
+typedef struct Pool {
+  PoolBlock *freelist[POOLCLASSES];
+  unsigned long hits[POOLCLASSES];  /* blocks reused from a free list */
+  unsigned long misses[POOLCLASSES];  /* blocks carved from a slab */
+  PoolChunk *chunks;  /* list of all slabs */
+  PoolLarge large;  /* head of (circular) list of large blocks */
+  char *top;  /* first free byte in current slab */
+  char *limit;  /* end of current slab */
+  void *first;  /* first block ever allocated */
+  void *state;  /* state block; freeing it releases the whole pool */
+} Pool;
+
+
+static void poolput (Pool *p, void *ptr, size_t sz) {
+  int c = poolclass(sz);
+  PoolBlock *b = (PoolBlock *)ptr;
+  b->next = p->freelist[c];
+  p->freelist[c] = b;
+}
+
+
+static void *poolget (Pool *p, size_t sz) {
+  int c = poolclass(sz);
+  PoolBlock *b = p->freelist[c];
+  if (b != NULL) {
+    p->freelist[c] = b->next;
+    p->hits[c]++;
+    return b;
+  }
+  if ((size_t)(p->limit - p->top) < classsize(c)) {  /* slab exhausted? */
+    PoolChunk *ck = (PoolChunk *)malloc(sizeof(PoolChunk) + LUAL_POOLCHUNKSIZE);
+    if (ck == NULL) return NULL;
+    if (p->top < p->limit)  /* keep what is left of the old slab */
+      poolput(p, p->top, (size_t)(p->limit - p->top));
+    ck->next = p->chunks;
+    p->chunks = ck;
+    p->top = (char *)(ck + 1);
+    p->limit = p->top + LUAL_POOLCHUNKSIZE;
+  }
+  b = (PoolBlock *)p->top;
+  p->top += classsize(c);
+  p->misses[c]++;
+  return b;
+}
+
+
+static void linklarge (Pool *p, PoolLarge *b) {
+  b->l.prev = &p->large;
+  b->l.next = p->large.l.next;
+  p->large.l.next->l.prev = b;
+  p->large.l.next = b;
+}
+
+
+static void unlinklarge (PoolLarge *b) {
+  b->l.prev->l.next = b->l.next;
+  b->l.next->l.prev = b->l.prev;
+}
+
+
+static void *largerealloc (Pool *p, void *ptr, size_t nsize) {
+  PoolLarge *b = (ptr == NULL) ? NULL : (PoolLarge *)ptr - 1;
+  PoolLarge *nb;
+  if (b != NULL) unlinklarge(b);  /* `realloc' may move it */
+  nb = (PoolLarge *)realloc(b, sizeof(PoolLarge) + nsize);
+  if (nb == NULL) {
+    if (b != NULL) linklarge(p, b);  /* old block is still valid */
+    return NULL;
+  }
+  linklarge(p, nb);
+  return nb + 1;
+}
+
+
+static void largefree (void *ptr) {
+  PoolLarge *b = (PoolLarge *)ptr - 1;
+  unlinklarge(b);
+  free(b);
+}
+
+
+static Pool *newpool (void) {
+  Pool *p = (Pool *)calloc(1, sizeof(Pool));
+  if (p != NULL)
+    p->large.l.prev = p->large.l.next = &p->large;
+  return p;
+}
+
+
+static void freepool (Pool *p) {
+  PoolChunk *ck = p->chunks;
+  PoolLarge *b = p->large.l.next;
+  while (ck != NULL) {
+    PoolChunk *next = ck->next;
+    free(ck);
+    ck = next;
+  }
+  while (b != &p->large) {
+    PoolLarge *next = b->l.next;
+    free(b);
+    b = next;
+  }
+  free(p);
+}
+
+
+static void *l_poolalloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  Pool *p = (Pool *)ud;
+  void *nptr;
+  if (nsize == 0) {
+    if (ptr == NULL) return NULL;
+    if (ptr == p->state) freepool(p);  /* closing the state */
+    else if (inpool(osize)) poolput(p, ptr, osize);
+    else largefree(ptr);
+    return NULL;
+  }
+  if (ptr != NULL && inpool(osize) && inpool(nsize) &&
+      poolclass(osize) == poolclass(nsize))
+    return ptr;  /* block already has the right size */
+  else if (!inpool(nsize) && (ptr == NULL || !inpool(osize)))
+    nptr = largerealloc(p, ptr, nsize);
+  else {  /* block moves into, out of, or between size classes */
+    nptr = inpool(nsize) ? poolget(p, nsize) : largerealloc(p, NULL, nsize);
+    if (nptr == NULL) return NULL;
+    if (ptr != NULL) {
+      memcpy(nptr, ptr, (osize < nsize) ? osize : nsize);
+      if (inpool(osize)) poolput(p, ptr, osize);
+      else largefree(ptr);
+    }
+  }
+  if (p->first == NULL) p->first = nptr;
+  return nptr;
+}
+
+
+LUALIB_API lua_State *luaL_newpooledstate (void) {
+  lua_State *L;
+  Pool *p = newpool();
+  if (p == NULL) return NULL;
+  L = lua_newstate(l_poolalloc, p);
+  if (L == NULL) {  /* partial state (if any) was already freed */
+    freepool(p);
+    return NULL;
+  }
+  p->state = p->first;  /* `lua_newstate' allocates the state block first */
+  lua_atpanic(L, &panic);
+  return L;
+}
+
+
+/*
+** An arena state is a pooled state that `lua_close' tears down by
+** releasing the slabs, without freeing its objects one by one. Pending
+** finalizers (`__gc' metamethods) still run as usual.
+*/
+LUALIB_API lua_State *luaL_newarenastate (void) {
+  lua_State *L = luaL_newpooledstate();
+  if (L) lua_setbulkfree(L, 1);
   return L;
 }
 
+
+/*
+** Statistics of size class `c' of a state created by `luaL_newpooledstate'.
+** Returns 0 if `L' does not use a pool or `c' is not a valid class.
+*/
+LUALIB_API int luaL_poolstats (lua_State *L, int c, size_t *size,
+                               unsigned long *hits, unsigned long *misses) {
+  void *ud;
+  Pool *p;
+  if (lua_getallocf(L, &ud) != l_poolalloc || c < 0 || c >= POOLCLASSES)
+    return 0;
+  p = (Pool *)ud;
+  if (size) *size = classsize(c);
+  if (hits) *hits = p->hits[c];
+  if (misses) *misses = p->misses[c];
+  return 1;
+}
+
+/* }====================================================== */
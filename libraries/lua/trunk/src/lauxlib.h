@@ -80,6 +80,11 @@ LUALIB_API int (luaL_loadbuffer) (lua_State *L, const char *buff, size_t sz,
 LUALIB_API int (luaL_loadstring) (lua_State *L, const char *s);
 
 LUALIB_API lua_State *(luaL_newstate) (void);
+LUALIB_API lua_State *(luaL_clonestate) (lua_State *L);
+LUALIB_API lua_State *(luaL_newpooledstate) (void);
+LUALIB_API lua_State *(luaL_newarenastate) (void);
+LUALIB_API int (luaL_poolstats) (lua_State *L, int c, size_t *size,
+                                 unsigned long *hits, unsigned long *misses);
 
 
 LUALIB_API const char *(luaL_gsub) (lua_State *L, const char *s, const char *p,
@@ -126,6 +131,23 @@ LUALIB_API const char *(luaL_findtable) (lua_State *L, int idx,
 
 
 
+#if defined(LUAL_BUFFERGROW)
+
+typedef struct luaL_Buffer {
+  char *p;			/* current position in buffer */
+  char *b;  /* start of buffer: `buffer' or a block kept in the stack */
+  size_t size;  /* size of `b' */
+  int lvl;  /* number of blocks in the stack (0 or 1) */
+  lua_State *L;
+  char buffer[LUAL_BUFFERSIZE];
+} luaL_Buffer;
+
+#define luaL_addchar(B,c) \
+  ((void)((B)->p < (B)->b + (B)->size || luaL_prepbuffer(B)), \
+   (*(B)->p++ = (char)(c)))
+
+#else
+
 typedef struct luaL_Buffer {
   char *p;			/* current position in buffer */
   int lvl;  /* number of strings in the stack (level) */
@@ -137,6 +159,8 @@ typedef struct luaL_Buffer {
   ((void)((B)->p < ((B)->buffer+LUAL_BUFFERSIZE) || luaL_prepbuffer(B)), \
    (*(B)->p++ = (char)(c)))
 
+#endif
+
 /* compatibility only */
 #define luaL_putchar(B,c)	luaL_addchar(B,c)
 
@@ -148,6 +172,9 @@ LUALIB_API void (luaL_addlstring) (luaL_Buffer *B, const char *s, size_t l);
 LUALIB_API void (luaL_addstring) (luaL_Buffer *B, const char *s);
 LUALIB_API void (luaL_addvalue) (luaL_Buffer *B);
 LUALIB_API void (luaL_pushresult) (luaL_Buffer *B);
+#if defined(LUAL_BUFFERGROW)
+LUALIB_API char *(luaL_prepbuffsize) (luaL_Buffer *B, size_t sz);
+#endif
 
 
 /* }====================================================== */
@@ -190,24 +190,61 @@ static int luaB_gcinfo (lua_State *L) {
 }
 
 
+static int gcstats (lua_State *L) {
+  lua_GCStats s;
+  lua_gcstats(L, &s);
+  lua_createtable(L, 0, 10);
+  lua_pushnumber(L, (lua_Number)s.cycles);
+  lua_setfield(L, -2, "cycles");
+  lua_pushnumber(L, s.propagate);
+  lua_setfield(L, -2, "propagate");
+  lua_pushnumber(L, s.atomic);
+  lua_setfield(L, -2, "atomic");
+  lua_pushnumber(L, s.sweepstring);
+  lua_setfield(L, -2, "sweepstring");
+  lua_pushnumber(L, s.sweep);
+  lua_setfield(L, -2, "sweep");
+  lua_pushnumber(L, s.finalize);
+  lua_setfield(L, -2, "finalize");
+  lua_pushnumber(L, s.maxpause);
+  lua_setfield(L, -2, "maxpause");
+  lua_pushnumber(L, (lua_Number)s.freed);
+  lua_setfield(L, -2, "freed");
+  lua_pushnumber(L, (lua_Number)s.threshold);
+  lua_setfield(L, -2, "threshold");
+  lua_pushnumber(L, (lua_Number)s.estimate);
+  lua_setfield(L, -2, "estimate");
+  return 1;
+}
+
+
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
-    "count", "step", "setpause", "setstepmul", NULL};
+    "count", "step", "setpause", "setstepmul", "generational",
+    "incremental", "steptime", "bgsweep", "stats", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
-    LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL};
+    LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL, LUA_GCGEN,
+    LUA_GCINC, LUA_GCSTEPTIME, LUA_GCBGSWEEP, -1};
   int o = luaL_checkoption(L, 1, "collect", opts);
   int ex = luaL_optint(L, 2, 0);
-  int res = lua_gc(L, optsnum[o], ex);
+  int res;
+  if (optsnum[o] == -1)  /* "stats"? */
+    return gcstats(L);
+  res = lua_gc(L, optsnum[o], ex);
   switch (optsnum[o]) {
     case LUA_GCCOUNT: {
       int b = lua_gc(L, LUA_GCCOUNTB, 0);
       lua_pushnumber(L, res + ((lua_Number)b/1024));
       return 1;
     }
-    case LUA_GCSTEP: {
+    case LUA_GCSTEP: case LUA_GCSTEPTIME: {
       lua_pushboolean(L, res);
       return 1;
     }
+    case LUA_GCGEN: case LUA_GCINC: {
+      lua_pushstring(L, (res == LUA_GCGEN) ? "generational" : "incremental");
+      return 1;
+    }
     default: {
       lua_pushnumber(L, res);
       return 1;
@@ -602,6 +639,119 @@ static int luaB_corunning (lua_State *L) {
 }
 
 
+/*
+** A pool keeps finished coroutines, reset by `lua_resetthread', to run
+** new functions without creating new threads. The array part of the pool
+** holds the coroutines (as keys in the hash part too, to find them);
+** field `size' is the maximum number of coroutines it keeps.
+*/
+
+static int pool_release (lua_State *L, int pool, int co) {
+  lua_State *NL = lua_tothread(L, co);
+  int n = lua_objlen(L, pool);
+  int kept = 0;
+  lua_getfield(L, pool, "size");
+  lua_pushvalue(L, co);
+  lua_rawget(L, pool);
+  if (n < lua_tointeger(L, -2) && lua_isnil(L, -1) && NL != L &&
+      lua_resetthread(NL)) {
+    lua_pushvalue(L, co);
+    lua_rawseti(L, pool, n + 1);
+    lua_pushvalue(L, co);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, pool);
+    kept = 1;
+  }
+  lua_pop(L, 2);
+  return kept;
+}
+
+
+static int luaB_poolcreate (lua_State *L) {
+  int n;
+  luaL_checktype(L, 1, LUA_TTABLE);
+  luaL_argcheck(L, lua_isfunction(L, 2) && !lua_iscfunction(L, 2), 2,
+    "Lua function expected");
+  n = lua_objlen(L, 1);
+  if (n > 0) {  /* take a coroutine from the pool */
+    lua_rawgeti(L, 1, n);
+    lua_pushnil(L);
+    lua_rawseti(L, 1, n);
+    lua_pushvalue(L, -1);
+    lua_pushnil(L);
+    lua_rawset(L, 1);
+  }
+  else
+    lua_newthread(L);
+  lua_pushvalue(L, 2);  /* move function to top */
+  lua_xmove(L, lua_tothread(L, -2), 1);  /* move function to coroutine */
+  return 1;
+}
+
+
+static int luaB_poolrelease (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  luaL_argcheck(L, lua_tothread(L, 2), 2, "coroutine expected");
+  lua_pushboolean(L, pool_release(L, 1, 2));
+  return 1;
+}
+
+
+static int luaB_poolauxwrap (lua_State *L) {
+  lua_State *co = lua_tothread(L, lua_upvalueindex(1));
+  int r;
+  if (co == NULL) {  /* finished and given back to the pool? */
+    luaL_where(L, 1);
+    lua_pushliteral(L, "cannot resume dead coroutine");
+    lua_concat(L, 2);
+    return lua_error(L);
+  }
+  r = auxresume(L, co, lua_gettop(L));
+  if (costatus(L, co) == CO_DEAD) {  /* give it back */
+    lua_checkstack(L, 4);
+    pool_release(L, lua_upvalueindex(2), lua_upvalueindex(1));
+    lua_pushboolean(L, 0);
+    lua_replace(L, lua_upvalueindex(1));
+  }
+  if (r < 0) {
+    if (lua_isstring(L, -1)) {  /* error object is a string? */
+      luaL_where(L, 1);  /* add extra info */
+      lua_insert(L, -2);
+      lua_concat(L, 2);
+    }
+    lua_error(L);  /* propagate error */
+  }
+  return r;
+}
+
+
+static int luaB_poolwrap (lua_State *L) {
+  luaB_poolcreate(L);
+  lua_pushvalue(L, 1);
+  lua_pushcclosure(L, luaB_poolauxwrap, 2);
+  return 1;
+}
+
+
+static int luaB_copool (lua_State *L) {
+  int size = luaL_optint(L, 1, 64);
+  lua_createtable(L, 0, 1);
+  lua_pushinteger(L, size);
+  lua_setfield(L, -2, "size");
+  lua_pushvalue(L, lua_upvalueindex(1));
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+
+static const luaL_Reg pool_funcs[] = {
+  {"create", luaB_poolcreate},
+  {"release", luaB_poolrelease},
+  {"wrap", luaB_poolwrap},
+  {NULL, NULL}
+};
+
+
 static const luaL_Reg co_funcs[] = {
   {"create", luaB_cocreate},
   {"resume", luaB_coresume},
@@ -648,6 +798,13 @@ static void base_open (lua_State *L) {
 LUALIB_API int luaopen_base (lua_State *L) {
   base_open(L);
   luaL_register(L, LUA_COLIBNAME, co_funcs);
+  /* `pool' needs the metatable of pools as upvalue */
+  lua_createtable(L, 0, 4);
+  luaL_register(L, NULL, pool_funcs);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pushcclosure(L, luaB_copool, 1);
+  lua_setfield(L, -2, "pool");
   return 2;
 }
 
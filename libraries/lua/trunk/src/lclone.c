@@ -0,0 +1,336 @@
+/*
+** Cloning of pre-initialized states
+** See Copyright Notice in lua.h
+*/
+
+
+#include <string.h>
+
+#define lclone_c
+#define LUA_CORE
+
+#include "lua.h"
+
+#include "ldebug.h"
+#include "ldo.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "lstring.h"
+#include "ltable.h"
+
+
+
+/*
+** A clone is a deep copy of everything reachable from the registry, the
+** table of globals and the metatables for basic types of a template state.
+** Objects are copied in two steps: `copyobj' creates an empty object in
+** the new state and queues the original; `fillobj' later copies its
+** contents. So there is no C recursion over the object graph.
+** Tables with weak values (caches) are copied empty.
+**
+** A userdata may refer to resources (files, libraries, etc.) that a byte
+** copy would share with the template, so its block is copied only when
+** its metatable has a `__clone' C function. That function is called in
+** the new state with the copy (which has no metatable yet) and must make
+** it independent of the template or raise an error, which fails the
+** clone. Empty userdata need no `__clone'. Coroutines and open upvalues
+** cannot be cloned. The new state does no collection while it is built.
+*/
+
+
+typedef struct CloneState {
+  lua_State *from;  /* template */
+  lua_State *L;  /* new state */
+  Table *map;  /* original object (as light userdata) -> its copy */
+  Table *pending;  /* originals whose contents were not copied yet */
+  int npending;
+} CloneState;
+
+
+#define setgcovalue(obj,x,t) \
+  { TValue *i_o=(obj); i_o->value.gc=(x); i_o->tt=(t); }
+
+
+static TString *copystr (CloneState *cs, TString *ts) {
+  if (ts == NULL) return NULL;
+  return luaS_newlstr(cs->L, getstr(ts), ts->tsv.len);
+}
+
+
+/* calls the `__clone' of userdata `u' for its copy `nu' */
+static void clonehook (CloneState *cs, Udata *u, Udata *nu) {
+  lua_State *L = cs->L;
+  const TValue *tm = (u->uv.metatable == NULL) ? luaO_nilobject :
+      luaH_getstr(u->uv.metatable, G(cs->from)->tmname[TM_CLONE]);
+  Closure *cl;
+  if (!ttisfunction(tm) || !clvalue(tm)->c.isC)
+    luaG_runerror(L, "cannot clone a userdata without " LUA_QL("__clone"));
+  cl = luaF_newCclosure(L, 0, hvalue(gt(L)));
+  cl->c.f = clvalue(tm)->c.f;
+  luaD_checkstack(L, 2);
+  setclvalue(L, L->top, cl);
+  setuvalue(L, L->top + 1, nu);
+  L->top += 2;
+  luaD_call(L, L->top - 2, 0);
+}
+
+
+static GCObject *newcopy (CloneState *cs, GCObject *o) {
+  lua_State *L = cs->L;
+  switch (o->gch.tt) {
+    case LUA_TTABLE: {
+      Table *h = gco2h(o);
+      return obj2gco(luaH_new(L, h->sizearray,
+                              (h->lsizenode == 0) ? 0 : sizenode(h)));
+    }
+    case LUA_TFUNCTION: {
+      Closure *cl = gco2cl(o);
+      Closure *ncl;
+      if (cl->c.isC) {
+        int i;
+        ncl = luaF_newCclosure(L, cl->c.nupvalues, NULL);
+        ncl->c.f = cl->c.f;
+        for (i = 0; i < cl->c.nupvalues; i++)
+          setnilvalue(&ncl->c.upvalue[i]);
+      }
+      else
+        ncl = luaF_newLclosure(L, cl->l.nupvalues, NULL);
+      return obj2gco(ncl);
+    }
+    case LUA_TUSERDATA: {
+      Udata *u = rawgco2u(o);
+      Udata *nu = luaS_newudata(L, u->uv.len, hvalue(gt(L)));
+      memcpy(nu + 1, u + 1, u->uv.len);
+      if (u->uv.len > 0) clonehook(cs, u, nu);
+      return obj2gco(nu);
+    }
+    case LUA_TPROTO: {
+      return obj2gco(luaF_newproto(L));
+    }
+    case LUA_TUPVAL: {
+      if (gco2uv(o)->v != &gco2uv(o)->u.value)
+        luaG_runerror(L, "cannot clone an open upvalue");
+      return obj2gco(luaF_newupval(L));
+    }
+    default: {
+      lua_assert(o->gch.tt == LUA_TTHREAD);
+      luaG_runerror(L, "cannot clone a coroutine");
+      return NULL;  /* to avoid warnings */
+    }
+  }
+}
+
+
+static void setcopy (CloneState *cs, GCObject *o, GCObject *copy) {
+  TValue key;
+  setpvalue(&key, o);
+  setgcovalue(luaH_set(cs->L, cs->map, &key), copy, o->gch.tt);
+}
+
+
+static GCObject *copyobj (CloneState *cs, GCObject *o) {
+  TValue key;
+  const TValue *res;
+  GCObject *copy;
+  if (o == NULL) return NULL;
+  setpvalue(&key, o);
+  res = luaH_get(cs->map, &key);
+  if (!ttisnil(res)) return gcvalue(res);
+  copy = newcopy(cs, o);
+  setcopy(cs, o, copy);
+  setpvalue(luaH_setnum(cs->L, cs->pending, ++cs->npending), o);
+  return copy;
+}
+
+
+static void copyvalue (CloneState *cs, const TValue *o, TValue *res) {
+  if (ttisstring(o)) {
+    setsvalue(cs->L, res, copystr(cs, rawtsvalue(o)));
+  }
+  else if (iscollectable(o)) {
+    setgcovalue(res, copyobj(cs, gcvalue(o)), ttype(o));
+  }
+  else {
+    setobj(cs->L, res, o);
+  }
+}
+
+
+#define copytable(cs,h)	gco2h(copyobj(cs, obj2gco(h)))
+
+
+/* values in a table with weak values may go away at any time */
+static int weakvalues (CloneState *cs, Table *h) {
+  const TValue *mode = gfasttm(G(cs->from), h->metatable, TM_MODE);
+  return (mode && ttisstring(mode) && strchr(svalue(mode), 'v') != NULL);
+}
+
+
+static void filltable (CloneState *cs, Table *h, Table *nh) {
+  lua_State *L = cs->L;
+  int i;
+  nh->metatable = (h->metatable) ? copytable(cs, h->metatable) : NULL;
+  if (weakvalues(cs, h))
+    return;  /* so the copy starts empty (as a cache of the template) */
+  for (i = 0; i < h->sizearray; i++) {
+    TValue v;
+    copyvalue(cs, &h->array[i], &v);
+    setobj2t(L, luaH_setnum(L, nh, i + 1), &v);
+  }
+  for (i = sizenode(h) - 1; i >= 0; i--) {
+    Node *n = gnode(h, i);
+    if (!ttisnil(gval(n))) {
+      TValue k, v;
+      copyvalue(cs, key2tval(n), &k);
+      copyvalue(cs, gval(n), &v);
+      setobj2t(L, luaH_set(L, nh, &k), &v);
+    }
+  }
+}
+
+
+static void fillproto (CloneState *cs, Proto *f, Proto *nf) {
+  lua_State *L = cs->L;
+  int i;
+  nf->source = copystr(cs, f->source);
+  nf->code = luaM_newvector(L, f->sizecode, Instruction);
+  memcpy(nf->code, f->code, f->sizecode * sizeof(Instruction));
+  nf->sizecode = f->sizecode;
+  luaF_newcache(L, nf);
+  nf->lineinfo = luaM_newvector(L, f->sizelineinfo, int);
+  memcpy(nf->lineinfo, f->lineinfo, f->sizelineinfo * sizeof(int));
+  nf->sizelineinfo = f->sizelineinfo;
+  nf->k = luaM_newvector(L, f->sizek, TValue);
+  for (nf->sizek = 0; nf->sizek < f->sizek; nf->sizek++)
+    setnilvalue(&nf->k[nf->sizek]);
+  for (i = 0; i < f->sizek; i++)
+    copyvalue(cs, &f->k[i], &nf->k[i]);
+  nf->p = luaM_newvector(L, f->sizep, Proto *);
+  for (nf->sizep = 0; nf->sizep < f->sizep; nf->sizep++)
+    nf->p[nf->sizep] = gco2p(copyobj(cs, obj2gco(f->p[nf->sizep])));
+  nf->locvars = luaM_newvector(L, f->sizelocvars, LocVar);
+  for (nf->sizelocvars = 0; nf->sizelocvars < f->sizelocvars;
+       nf->sizelocvars++) {
+    LocVar *lv = &f->locvars[nf->sizelocvars];
+    nf->locvars[nf->sizelocvars].varname = copystr(cs, lv->varname);
+    nf->locvars[nf->sizelocvars].startpc = lv->startpc;
+    nf->locvars[nf->sizelocvars].endpc = lv->endpc;
+  }
+  nf->upvalues = luaM_newvector(L, f->sizeupvalues, TString *);
+  for (nf->sizeupvalues = 0; nf->sizeupvalues < f->sizeupvalues;
+       nf->sizeupvalues++) {
+    TString *name = f->upvalues[nf->sizeupvalues];
+    nf->upvalues[nf->sizeupvalues] = copystr(cs, name);
+  }
+  nf->linedefined = f->linedefined;
+  nf->lastlinedefined = f->lastlinedefined;
+  nf->nups = f->nups;
+  nf->numparams = f->numparams;
+  nf->is_vararg = f->is_vararg;
+  nf->maxstacksize = f->maxstacksize;
+}
+
+
+static void fillobj (CloneState *cs, GCObject *o, GCObject *copy) {
+  switch (o->gch.tt) {
+    case LUA_TTABLE: {
+      filltable(cs, gco2h(o), gco2h(copy));
+      break;
+    }
+    case LUA_TFUNCTION: {
+      Closure *cl = gco2cl(o);
+      Closure *ncl = gco2cl(copy);
+      int i;
+      ncl->c.env = copytable(cs, cl->c.env);
+      if (cl->c.isC) {
+        for (i = 0; i < cl->c.nupvalues; i++)
+          copyvalue(cs, &cl->c.upvalue[i], &ncl->c.upvalue[i]);
+      }
+      else {
+        ncl->l.p = gco2p(copyobj(cs, obj2gco(cl->l.p)));
+        for (i = 0; i < cl->l.nupvalues; i++)
+          ncl->l.upvals[i] = gco2uv(copyobj(cs, obj2gco(cl->l.upvals[i])));
+      }
+      break;
+    }
+    case LUA_TUSERDATA: {
+      Udata *u = rawgco2u(o);
+      Udata *nu = rawgco2u(copy);
+      nu->uv.metatable = (u->uv.metatable) ?
+                         copytable(cs, u->uv.metatable) : NULL;
+      nu->uv.env = copytable(cs, u->uv.env);
+      break;
+    }
+    case LUA_TPROTO: {
+      fillproto(cs, gco2p(o), gco2p(copy));
+      break;
+    }
+    case LUA_TUPVAL: {
+      copyvalue(cs, gco2uv(o)->v, &gco2uv(copy)->u.value);
+      break;
+    }
+    default: lua_assert(0);
+  }
+}
+
+
+static void f_clone (lua_State *L, void *ud) {
+  CloneState *cs = cast(CloneState *, ud);
+  lua_State *from = cs->from;
+  global_State *g = G(L);
+  int i;
+  g->GCthreshold = MAX_LUMEM;  /* `map' and copies are not anchored */
+  cs->map = luaH_new(L, 0, 0);
+  cs->pending = luaH_new(L, 0, 0);
+  cs->npending = 0;
+  /* roots already exist in the new state; only their contents are copied */
+  setcopy(cs, obj2gco(G(from)->mainthread), obj2gco(g->mainthread));
+  setcopy(cs, gcvalue(registry(from)), gcvalue(registry(L)));
+  setcopy(cs, gcvalue(gt(from)), gcvalue(gt(L)));
+  filltable(cs, hvalue(registry(from)), hvalue(registry(L)));
+  filltable(cs, hvalue(gt(from)), hvalue(gt(L)));
+  for (i = 0; i < NUM_TAGS; i++)
+    if (G(from)->mt[i]) g->mt[i] = copytable(cs, G(from)->mt[i]);
+  for (i = 1; i <= cs->npending; i++) {  /* `npending' grows in the loop */
+    GCObject *o = cast(GCObject *, pvalue(luaH_getnum(cs->pending, i)));
+    TValue key;
+    setpvalue(&key, o);
+    fillobj(cs, o, gcvalue(luaH_get(cs->map, &key)));
+  }
+  g->gcpause = G(from)->gcpause;
+  g->gcstepmul = G(from)->gcstepmul;
+  g->GCthreshold = (g->totalbytes/100) * g->gcpause;
+}
+
+
+/*
+** Creates a new state with a copy of the objects of state `from' (see
+** above). On errors, returns NULL and pushes an error message on `from'.
+*/
+LUA_API lua_State *lua_clonestate (lua_State *from, lua_Alloc f, void *ud) {
+  CloneState cs;
+  int status;
+  lua_State *L = lua_newstate(f, ud);
+  if (L == NULL) {
+    lua_pushliteral(from, MEMERRMSG);
+    return NULL;
+  }
+  lua_lock(from);
+  cs.from = G(from)->mainthread;
+  cs.L = L;
+  status = luaD_rawrunprotected(L, f_clone, &cs);
+  lua_unlock(from);
+  if (status != 0) {
+    if (status == LUA_ERRMEM)
+      lua_pushliteral(from, MEMERRMSG);
+    else
+      lua_pushstring(from, svalue(L->top - 1));
+    lua_close(L);
+    return NULL;
+  }
+  return L;
+}
+
@@ -256,7 +256,7 @@ int luaK_stringK (FuncState *fs, TString *s) {
 
 int luaK_numberK (FuncState *fs, lua_Number r) {
   TValue o;
-  setnvalue(&o, r);
+  luaO_setnumber(&o, r);
   return addk(fs, &o, &o);
 }
 
@@ -829,3 +829,48 @@ void luaK_setlist (FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
+
+
+/*
+** peephole pass over the finished code of a function: turns pairs of
+** instructions that are executed together into superinstructions (the
+** second instruction stays in place, so jumps need no fixing)
+*/
+void luaK_fuse (FuncState *fs) {
+#if defined(LUAI_FUSEOPS)
+  Proto *f = fs->f;
+  int pc;
+  for (pc = 0; pc < fs->pc - 1; pc++) {
+    Instruction *i = &f->code[pc];
+    Instruction next = f->code[pc+1];
+    switch (GET_OPCODE(*i)) {
+      case OP_GETGLOBAL:
+      case OP_GETUPVAL:
+      case OP_GETTABLE: {  /* followed by an index of its result? */
+        if (GET_OPCODE(next) == OP_GETTABLE &&
+            GETARG_B(next) == GETARG_A(*i) &&
+            f->lineinfo[pc] == f->lineinfo[pc+1]) {  /* keep line hooks */
+          switch (GET_OPCODE(*i)) {
+            case OP_GETGLOBAL: SET_OPCODE(*i, OP_GETGINDEX); break;
+            case OP_GETUPVAL: SET_OPCODE(*i, OP_GETUINDEX); break;
+            default: SET_OPCODE(*i, OP_GETTINDEX); break;
+          }
+          pc++;  /* skip the second OP_GETTABLE */
+        }
+        break;
+      }
+      case OP_CLOSURE: {  /* skip its pseudo-instructions */
+        pc += f->p[GETARG_Bx(*i)]->nups;
+        break;
+      }
+      case OP_SETLIST: {
+        if (GETARG_C(*i) == 0) pc++;  /* skip its real C */
+        break;
+      }
+      default: break;
+    }
+  }
+#else
+  UNUSED(fs);
+#endif
+}
@@ -25,6 +25,26 @@ static int db_getregistry (lua_State *L) {
 }
 
 
+#define MAXCHAIN	16
+
+
+static int db_strtabstats (lua_State *L) {
+  unsigned long hist[MAXCHAIN];
+  int n = luaL_optint(L, 1, MAXCHAIN);
+  int i, size;
+  luaL_argcheck(L, 1 < n && n <= MAXCHAIN, 1, "out of range");
+  size = lua_strtabstats(L, hist, n);
+  lua_createtable(L, n, 0);
+  for (i = 0; i < n; i++) {
+    lua_pushnumber(L, (lua_Number)hist[i]);
+    lua_rawseti(L, -2, i + 1);  /* chains with `i' strings */
+  }
+  lua_pushinteger(L, size);
+  lua_insert(L, -2);
+  return 2;
+}
+
+
 static int db_getmetatable (lua_State *L) {
   luaL_checkany(L, 1);
   if (!lua_getmetatable(L, 1)) {
@@ -299,6 +319,18 @@ static int db_gethook (lua_State *L) {
 }
 
 
+static int db_setjit (lua_State *L) {
+  int old;
+  if (lua_toboolean(L, 1))
+    old = lua_setjit(L, luaL_checkint(L, 1));
+  else
+    old = lua_setjit(L, -1);  /* false or nil turn it off */
+  if (old < 0) lua_pushboolean(L, 0);
+  else lua_pushinteger(L, old);
+  return 1;
+}
+
+
 static int db_debug (lua_State *L) {
   for (;;) {
     char buffer[250];
@@ -384,8 +416,10 @@ static const luaL_Reg dblib[] = {
   {"setfenv", db_setfenv},
   {"sethook", db_sethook},
   {"setlocal", db_setlocal},
+  {"setjit", db_setjit},
   {"setmetatable", db_setmetatable},
   {"setupvalue", db_setupvalue},
+  {"strtabstats", db_strtabstats},
   {"traceback", db_errorfb},
   {NULL, NULL}
 };
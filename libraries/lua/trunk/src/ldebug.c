@@ -394,6 +394,16 @@ static Instruction symbexec (const Proto *pt, int lastpc, int reg) {
         check(ttisstring(&pt->k[b]));
         break;
       }
+      case OP_GETGINDEX:
+      case OP_GETUINDEX:
+      case OP_GETTINDEX: {
+        if (op == OP_GETGINDEX) check(ttisstring(&pt->k[b]));
+        if (op == OP_GETUINDEX) check(b < pt->nups);
+        /* the VM runs the next instruction too (see `luaK_fuse') */
+        check(pc+1 < pt->sizecode);
+        check(GET_OPCODE(pt->code[pc+1]) == OP_GETTABLE);
+        break;
+      }
       case OP_SELF: {
         checkreg(pt, a+1);
         if (reg == a+1) last = pc;
@@ -506,7 +516,8 @@ static const char *getobjname (lua_State *L, CallInfo *ci, int stackpos,
     i = symbexec(p, pc, stackpos);  /* try symbolic execution */
     lua_assert(pc != -1);
     switch (GET_OPCODE(i)) {
-      case OP_GETGLOBAL: {
+      case OP_GETGLOBAL:
+      case OP_GETGINDEX: {
         int g = GETARG_Bx(i);  /* global index */
         lua_assert(ttisstring(&p->k[g]));
         *name = svalue(&p->k[g]);
@@ -519,12 +530,14 @@ static const char *getobjname (lua_State *L, CallInfo *ci, int stackpos,
           return getobjname(L, ci, b, name);  /* get name for `b' */
         break;
       }
-      case OP_GETTABLE: {
+      case OP_GETTABLE:
+      case OP_GETTINDEX: {
         int k = GETARG_C(i);  /* key index */
         *name = kname(p, k);
         return "field";
       }
-      case OP_GETUPVAL: {
+      case OP_GETUPVAL:
+      case OP_GETUINDEX: {
         int u = GETARG_B(i);  /* upvalue index */
         *name = p->upvalues ? getstr(p->upvalues[u]) : "?";
         return "upvalue";
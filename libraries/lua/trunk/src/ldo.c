@@ -453,6 +453,41 @@ LUA_API int lua_yield (lua_State *L, int nresults) {
 }
 
 
+/*
+** Makes a thread that is not running (finished, dead by an error or
+** suspended) ready for a new function as if it were a new thread: closes
+** its upvalues and empties its stack, keeping its arrays, globals and
+** hooks. Returns 0 (and does nothing) if the thread is running or is
+** resuming another coroutine.
+*/
+LUA_API int lua_resetthread (lua_State *L) {
+  StkId o;
+  lua_lock(L);
+  if (L->status == 0 && L->ci != L->base_ci) {  /* active? */
+    lua_unlock(L);
+    return 0;
+  }
+  luaF_close(L, L->stack);  /* close all upvalues for this thread */
+  L->status = 0;
+  L->ci = L->base_ci;
+  restore_stack_limit(L);
+  for (o = L->stack; o < L->stack + L->stacksize; o++)
+    setnilvalue(o);  /* drop references to old values */
+  L->ci->func = L->stack;
+  L->base = L->ci->base = L->top = L->stack + 1;
+  L->ci->top = L->top + LUA_MINSTACK;
+  L->ci->nresults = 0;
+  L->ci->tailcalls = 0;
+  L->savedpc = NULL;
+  L->nCcalls = L->baseCcalls = 0;
+  L->allowhook = 1;
+  resethookcount(L);
+  L->errfunc = 0;
+  lua_unlock(L);
+  return 1;
+}
+
+
 int luaD_pcall (lua_State *L, Pfunc func, void *u,
                 ptrdiff_t old_top, ptrdiff_t ef) {
   int status;
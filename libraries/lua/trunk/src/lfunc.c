@@ -14,6 +14,7 @@
 
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -120,6 +121,7 @@ Proto *luaF_newproto (lua_State *L) {
   f->p = NULL;
   f->sizep = 0;
   f->code = NULL;
+  f->cache = NULL;
   f->sizecode = 0;
   f->sizelineinfo = 0;
   f->sizeupvalues = 0;
@@ -134,17 +136,37 @@ Proto *luaF_newproto (lua_State *L) {
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+#if defined(LUA_USE_JIT)
+  f->jit = NULL;
+  f->ncalls = 0;
+#endif
   return f;
 }
 
 
+/*
+** creates the inline caches of `f' (see `luaV_getfield'); must be called
+** once its code is complete
+*/
+void luaF_newcache (lua_State *L, Proto *f) {
+  int i;
+  f->cache = luaM_newvector(L, f->sizecode, int);
+  for (i = 0; i < f->sizecode; i++) f->cache[i] = 0;
+}
+
+
 void luaF_freeproto (lua_State *L, Proto *f) {
   luaM_freearray(L, f->code, f->sizecode, Instruction);
+  if (f->cache)
+    luaM_freearray(L, f->cache, f->sizecode, int);
   luaM_freearray(L, f->p, f->sizep, Proto *);
   luaM_freearray(L, f->k, f->sizek, TValue);
   luaM_freearray(L, f->lineinfo, f->sizelineinfo, int);
   luaM_freearray(L, f->locvars, f->sizelocvars, struct LocVar);
   luaM_freearray(L, f->upvalues, f->sizeupvalues, TString *);
+#if defined(LUA_USE_JIT)
+  luaJ_free(f);
+#endif
   luaM_free(L, f);
 }
 
@@ -29,7 +29,7 @@
 #define GCFINALIZECOST	100
 
 
-#define maskmarks	cast_byte(~(bitmask(BLACKBIT)|WHITEBITS))
+#define maskmarks	cast_byte(~(bitmask(BLACKBIT)|WHITEBITS|bitmask(OLDBIT)))
 
 #define makewhite(g,x)	\
    ((x)->gch.marked = cast_byte(((x)->gch.marked & maskmarks) | luaC_white(g)))
@@ -58,6 +58,25 @@
 
 #define setthreshold(g)  (g->GCthreshold = (g->estimate/100) * g->gcpause)
 
+#define addfreed(g,old)	((g)->gcfreed += (old) - (g)->totalbytes)
+
+/* phase times for `lua_gcstats' are only measured with LUAI_GCSTATS */
+#if defined(LUAI_GCSTATS)
+#define statclock(t)	luai_gcclock(t)
+#define addpause(g,t)	\
+  { if ((t) > (g)->gcstats.maxpause) (g)->gcstats.maxpause = (t); }
+#else
+#define statclock(t)	((t) = 0)
+#define addpause(g,t)	((void)(t))
+#endif
+
+
+/*
+** In generational mode the collector keeps the invariant (no black
+** object points to a white one) all the time, not only while marking
+*/
+#define keepinvariant(g)  (isgenerational(g) || g->gcstate == GCSpropagate)
+
 
 static void removeentry (Node *n) {
   lua_assert(ttisnil(gval(n)));
@@ -243,11 +262,10 @@ static void checkstacksizes (lua_State *L, StkId max) {
   int s_used = cast_int(max - L->stack);  /* part of stack in use */
   if (L->size_ci > LUAI_MAXCALLS)  /* handling overflow? */
     return;  /* do not touch the stacks */
-  if (4*ci_used < L->size_ci && 2*BASIC_CI_SIZE < L->size_ci)
+  if (4*ci_used < L->size_ci && 2*L->minci < L->size_ci)
     luaD_reallocCI(L, L->size_ci/2);  /* still big enough... */
   condhardstacktests(luaD_reallocCI(L, ci_used + 1));
-  if (4*s_used < L->stacksize &&
-      2*(BASIC_STACK_SIZE+EXTRA_STACK) < L->stacksize)
+  if (4*s_used < L->stacksize && 2*L->minstack < L->stacksize)
     luaD_reallocstack(L, L->stacksize/2);  /* still big enough... */
   condhardstacktests(luaD_reallocstack(L, s_used));
 }
@@ -386,11 +404,7 @@ static void freeobj (lua_State *L, GCObject *o) {
       luaE_freethread(L, gco2th(o));
       break;
     }
-    case LUA_TSTRING: {
-      G(L)->strt.nuse--;
-      luaM_freemem(L, o, sizestring(gco2ts(o)));
-      break;
-    }
+    case LUA_TSTRING: luaS_freestr(L, rawgco2ts(o)); break;
     case LUA_TUSERDATA: {
       luaM_freemem(L, o, sizeudata(gco2u(o)));
       break;
@@ -413,7 +427,10 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count) {
       sweepwholelist(L, &gco2th(curr)->openupval);
     if ((curr->gch.marked ^ WHITEBITS) & deadmask) {  /* not dead? */
       lua_assert(!isdead(g, curr) || testbit(curr->gch.marked, FIXEDBIT));
-      makewhite(g, curr);  /* make it white (for next cycle) */
+      if (isgenerational(g))  /* keep its marks; it is old now */
+        l_setbit(curr->gch.marked, OLDBIT);
+      else
+        makewhite(g, curr);  /* make it white (for next cycle) */
       p = &curr->gch.next;
     }
     else {  /* must erase `curr' */
@@ -525,6 +542,8 @@ static void remarkupvals (global_State *g) {
 static void atomic (lua_State *L) {
   global_State *g = G(L);
   size_t udsize;  /* total size of userdata to be finalized */
+  lua_Number t0, t;
+  statclock(t0);
   /* remark occasional upvalues of (maybe) dead threads */
   remarkupvals(g);
   /* traverse objects cautch by write barrier and by 'remarkupvals' */
@@ -550,6 +569,36 @@ static void atomic (lua_State *L) {
   g->sweepgc = &g->rootgc;
   g->gcstate = GCSsweepstring;
   g->estimate = g->totalbytes - udsize;  /* first estimate */
+  statclock(t);
+  g->gcstats.atomic += t - t0;
+}
+
+
+static void endcycle (global_State *g) {
+  g->gcstats.cycles++;
+  g->gcstats.freed = g->gcfreed;
+  g->gcfreed = 0;
+}
+
+
+/*
+** add time `t' to phase `state' (`atomic', which ends the propagate
+** phase, is timed by itself and `tatomic' is its share of `t')
+*/
+static void addphasetime (global_State *g, int state, lua_Number t,
+                          lua_Number tatomic) {
+#if defined(LUAI_GCSTATS)
+  lua_GCStats *s = &g->gcstats;
+  t -= tatomic;
+  switch (state) {
+    case GCSpause: case GCSpropagate: s->propagate += t; break;
+    case GCSsweepstring: s->sweepstring += t; break;
+    case GCSsweep: s->sweep += t; break;
+    default: s->finalize += t; break;
+  }
+#else
+  UNUSED(g); UNUSED(state); UNUSED(t); UNUSED(tatomic);
+#endif
 }
 
 
@@ -576,6 +625,7 @@ static l_mem singlestep (lua_State *L) {
         g->gcstate = GCSsweep;  /* end sweep-string phase */
       lua_assert(old >= g->totalbytes);
       g->estimate -= old - g->totalbytes;
+      addfreed(g, old);
       return GCSWEEPCOST;
     }
     case GCSsweep: {
@@ -583,10 +633,12 @@ static l_mem singlestep (lua_State *L) {
       g->sweepgc = sweeplist(L, g->sweepgc, GCSWEEPMAX);
       if (*g->sweepgc == NULL) {  /* nothing more to sweep? */
         checkSizes(L);
+        luaM_flushfree(L);
         g->gcstate = GCSfinalize;  /* end sweep phase */
       }
       lua_assert(old >= g->totalbytes);
       g->estimate -= old - g->totalbytes;
+      addfreed(g, old);
       return GCSWEEPMAX*GCSWEEPCOST;
     }
     case GCSfinalize: {
@@ -599,6 +651,7 @@ static l_mem singlestep (lua_State *L) {
       else {
         g->gcstate = GCSpause;  /* end collection */
         g->gcdept = 0;
+        endcycle(g);
         return 0;
       }
     }
@@ -607,17 +660,202 @@ static l_mem singlestep (lua_State *L) {
 }
 
 
+/*
+** run the collector until it reaches `state' (reading the clock only
+** when the phase changes)
+*/
+static void runtilstate (lua_State *L, int state) {
+  global_State *g = G(L);
+  lua_Number tatomic = g->gcstats.atomic;
+  lua_Number t0, t;
+  statclock(t0);
+  while (g->gcstate != state) {
+    int old = g->gcstate;
+    singlestep(L);
+    if (g->gcstate != old) {  /* phase changed? */
+      statclock(t);
+      addphasetime(g, old, t - t0, g->gcstats.atomic - tatomic);
+      tatomic = g->gcstats.atomic;
+      t0 = t;
+    }
+  }
+}
+
+
+/*
+** {======================================================
+** Generational mode
+** =======================================================
+*/
+
+/*
+** Objects that survive a collection in generational mode keep their
+** black mark and get OLDBIT; they are not traversed again until the next
+** major collection. Write barriers turn old objects that get new
+** references gray again (or mark the new referenced object), and threads
+** and weak tables stay in `grayagain' and `weak' between collections, so
+** that a minor collection only needs to traverse young objects plus
+** everything the mutator touched. Between collections the collector
+** stays in GCSpropagate, accumulating gray objects from barriers.
+*/
+
+
+/*
+** Sweep list `p' up to its first old object. New objects are always
+** linked at the head of their lists, so the rest of the list is old.
+** (Not always true: `luaS_resize' reorders string chains. A dead object
+** left behind is just kept until the next major collection.)
+*/
+static void sweepyoung (lua_State *L, GCObject **p) {
+  global_State *g = G(L);
+  int deadmask = otherwhite(g);
+  GCObject *curr;
+  while ((curr = *p) != NULL) {
+    if ((curr->gch.marked ^ WHITEBITS) & deadmask) {  /* not dead? */
+      if (testbit(curr->gch.marked, OLDBIT))
+        break;  /* reached the old generation */
+      l_setbit(curr->gch.marked, OLDBIT);
+      p = &curr->gch.next;
+    }
+    else {  /* must erase `curr' */
+      *p = curr->gch.next;
+      freeobj(L, curr);
+    }
+  }
+}
+
+
+/*
+** Minor collection: mark from the gray objects accumulated since the
+** last collection and sweep the young generation, all in one go
+*/
+static void youngcollection (lua_State *L) {
+  global_State *g = G(L);
+  lua_GCStats *s = &g->gcstats;
+  lu_mem old;
+  GCObject *o;
+  int i;
+  lua_Number t0, t;
+  statclock(t0);
+  lua_assert(isgenerational(g) && g->gcstate == GCSpropagate);
+  propagateall(g);
+  statclock(t);
+  s->propagate += t - t0;
+  atomic(L);
+  statclock(t0);
+  old = g->totalbytes;
+  for (i = 0; i < g->strt.size; i++)
+    sweepyoung(L, &g->strt.hash[i]);
+  statclock(t);
+  s->sweepstring += t - t0;
+  t0 = t;
+  g->gcstate = GCSsweep;
+  sweepyoung(L, &g->rootgc);
+  sweepyoung(L, &g->mainthread->next);  /* userdata */
+  /* after `atomic', `grayagain' holds all live threads */
+  for (o = g->grayagain; o != NULL; o = gco2th(o)->gclist)
+    sweepwholelist(L, &gco2th(o)->openupval);
+  lua_assert(old >= g->totalbytes);
+  g->estimate -= old - g->totalbytes;
+  addfreed(g, old);
+  checkSizes(L);
+  luaM_flushfree(L);
+  statclock(t);
+  s->sweep += t - t0;
+  t0 = t;
+  g->gcstate = GCSfinalize;
+  luaC_callGCTM(L);
+  statclock(t);
+  s->finalize += t - t0;
+  endcycle(g);
+  if (isgenerational(g))  /* mode not changed by a finalizer? */
+    g->gcstate = GCSpropagate;  /* keep gray lists for next collection */
+}
+
+
+/*
+** Major collection: turn all objects white and young again (freeing
+** those already known to be dead) and then collect them all as young
+*/
+static void majorcollection (lua_State *L) {
+  global_State *g = G(L);
+  g->gckind = KGC_NORMAL;
+  g->sweepstrgc = 0;
+  g->sweepgc = &g->rootgc;
+  g->gcstate = GCSsweepstring;
+  runtilstate(L, GCSfinalize);
+  g->gckind = KGC_GEN;
+  markroot(L);
+  youngcollection(L);
+  g->lastmajor = g->estimate;
+}
+
+
+static void generationalstep (lua_State *L) {
+  global_State *g = G(L);
+  lua_Number t0, t;
+  statclock(t0);
+  if (g->gcstate != GCSpropagate) {  /* called from a finalizer? */
+    g->GCthreshold = g->totalbytes + GCSTEPSIZE;
+    return;
+  }
+  if (g->estimate > (g->lastmajor/100) * LUAI_GCMAJOR)
+    majorcollection(L);  /* old generation grew too much */
+  else
+    youngcollection(L);
+  setthreshold(g);
+  statclock(t);
+  addpause(g, t - t0);
+}
+
+
+void luaC_changemode (lua_State *L, int mode) {
+  global_State *g = G(L);
+  if (mode == g->gckind) return;  /* nothing to change */
+  if (mode == KGC_GEN) {
+    /* finish current cycle; first minor collection will mark everything */
+    runtilstate(L, GCSpause);
+    markroot(L);
+    g->lastmajor = g->estimate = g->totalbytes;
+    g->gckind = KGC_GEN;
+  }
+  else {
+    /* sweep all objects to turn them white (and young) again */
+    g->gckind = KGC_NORMAL;
+    g->sweepstrgc = 0;
+    g->sweepgc = &g->rootgc;
+    g->gcstate = GCSsweepstring;
+    runtilstate(L, GCSfinalize);
+    g->gcdept = 0;
+    setthreshold(g);
+  }
+}
+
+/* }====================================================== */
+
+
 void luaC_step (lua_State *L) {
   global_State *g = G(L);
   l_mem lim = (GCSTEPSIZE/100) * g->gcstepmul;
+  int state = g->gcstate;
+  lua_Number t0, t, tatomic;
+  if (isgenerational(g)) {
+    generationalstep(L);
+    return;
+  }
   if (lim == 0)
     lim = (MAX_LUMEM-1)/2;  /* no limit */
   g->gcdept += g->totalbytes - g->GCthreshold;
+  tatomic = g->gcstats.atomic;
+  statclock(t0);
   do {
     lim -= singlestep(L);
     if (g->gcstate == GCSpause)
       break;
   } while (lim > 0);
+  statclock(t);
+  addphasetime(g, state, t - t0, g->gcstats.atomic - tatomic);
+  addpause(g, t - t0);
   if (g->gcstate != GCSpause) {
     if (g->gcdept < GCSTEPSIZE)
       g->GCthreshold = g->totalbytes + GCSTEPSIZE;  /* - lim/g->gcstepmul;*/
@@ -632,8 +870,52 @@ void luaC_step (lua_State *L) {
 }
 
 
+/*
+** Do collector work for about `budget' seconds of wall-clock time (see
+** `luai_gcclock'); the clock is read after every GCSTEPSIZE units of
+** work and at phase changes. A call made between cycles starts a new
+** one (as LUA_GCSTEP does, so that a host that stopped the collector
+** still gets cycles); a call stops when its cycle finishes, returning 1,
+** instead of going on into the next one.
+*/
+int luaC_steptime (lua_State *L, lua_Number budget) {
+  global_State *g = G(L);
+  lua_Number tatomic = g->gcstats.atomic;
+  lua_Number tstart, t0, t;
+  l_mem work = 0;
+  luai_gcclock(tstart);
+  t0 = t = tstart;
+  if (isgenerational(g)) {  /* minor collections cannot be split */
+    generationalstep(L);
+    return 1;
+  }
+  do {  /* (at GCSpause, the first step starts the new cycle) */
+    int old = g->gcstate;
+    work += singlestep(L);
+    if (g->gcstate != old || work >= cast(l_mem, GCSTEPSIZE)) {
+      luai_gcclock(t);
+      addphasetime(g, old, t - t0, g->gcstats.atomic - tatomic);
+      tatomic = g->gcstats.atomic;
+      t0 = t;
+      work = 0;
+    }
+  } while (g->gcstate != GCSpause && t - tstart < budget);
+  addpause(g, t - tstart);
+  if (g->gcstate == GCSpause) {
+    setthreshold(g);
+    return 1;
+  }
+  return 0;
+}
+
+
 void luaC_fullgc (lua_State *L) {
   global_State *g = G(L);
+  if (isgenerational(g)) {
+    majorcollection(L);
+    setthreshold(g);
+    return;
+  }
   if (g->gcstate <= GCSpropagate) {
     /* reset sweep marks to sweep all elements (returning them to white) */
     g->sweepstrgc = 0;
@@ -646,14 +928,9 @@ void luaC_fullgc (lua_State *L) {
   }
   lua_assert(g->gcstate != GCSpause && g->gcstate != GCSpropagate);
   /* finish any pending sweep phase */
-  while (g->gcstate != GCSfinalize) {
-    lua_assert(g->gcstate == GCSsweepstring || g->gcstate == GCSsweep);
-    singlestep(L);
-  }
+  runtilstate(L, GCSfinalize);
   markroot(L);
-  while (g->gcstate != GCSpause) {
-    singlestep(L);
-  }
+  runtilstate(L, GCSpause);
   setthreshold(g);
 }
 
@@ -661,10 +938,11 @@ void luaC_fullgc (lua_State *L) {
 void luaC_barrierf (lua_State *L, GCObject *o, GCObject *v) {
   global_State *g = G(L);
   lua_assert(isblack(o) && iswhite(v) && !isdead(g, v) && !isdead(g, o));
-  lua_assert(g->gcstate != GCSfinalize && g->gcstate != GCSpause);
+  lua_assert(isgenerational(g) ||
+             (g->gcstate != GCSfinalize && g->gcstate != GCSpause));
   lua_assert(ttype(&o->gch) != LUA_TTABLE);
   /* must keep invariant? */
-  if (g->gcstate == GCSpropagate)
+  if (keepinvariant(g))
     reallymarkobject(g, v);  /* restore invariant */
   else  /* don't mind */
     makewhite(g, o);  /* mark as white just to avoid other barriers */
@@ -675,7 +953,8 @@ void luaC_barrierback (lua_State *L, Table *t) {
   global_State *g = G(L);
   GCObject *o = obj2gco(t);
   lua_assert(isblack(o) && !isdead(g, o));
-  lua_assert(g->gcstate != GCSfinalize && g->gcstate != GCSpause);
+  lua_assert(isgenerational(g) ||
+             (g->gcstate != GCSfinalize && g->gcstate != GCSpause));
   black2gray(o);  /* make table gray (again) */
   t->gclist = g->grayagain;
   g->grayagain = o;
@@ -696,8 +975,9 @@ void luaC_linkupval (lua_State *L, UpVal *uv) {
   GCObject *o = obj2gco(uv);
   o->gch.next = g->rootgc;  /* link upvalue into `rootgc' list */
   g->rootgc = o;
+  resetbit(o->gch.marked, OLDBIT);  /* is young in `rootgc' */
   if (isgray(o)) { 
-    if (g->gcstate == GCSpropagate) {
+    if (keepinvariant(g)) {
       gray2black(o);  /* closed upvalues need barrier */
       luaC_barrier(L, uv, uv->v);
     }
@@ -148,6 +148,19 @@ static int io_gc (lua_State *L) {
 }
 
 
+/*
+** called by `lua_clonestate' for the copy of a file handle (which has no
+** metatable yet): a clone may share closed files and the standard files
+** (which it cannot close), but other files belong to the template
+*/
+static int io_clone (lua_State *L) {
+  FILE *f = *(FILE **)lua_touserdata(L, 1);
+  if (f != NULL && f != stdin && f != stdout && f != stderr)
+    luaL_error(L, "cannot clone an open file");
+  return 0;
+}
+
+
 static int io_tostring (lua_State *L) {
   FILE *f = *tofilep(L);
   if (f == NULL)
@@ -319,6 +332,18 @@ static int read_chars (lua_State *L, FILE *f, size_t n) {
   luaL_Buffer b;
   luaL_buffinit(L, &b);
   rlen = LUAL_BUFFERSIZE;  /* try to read that much each time */
+#if defined(LUAL_BUFFERGROW)
+  for (;;) {  /* buffer grows as one block: read more each time */
+    char *p;
+    if (rlen > n) rlen = n;  /* cannot read more than asked */
+    p = luaL_prepbuffsize(&b, rlen);
+    nr = fread(p, sizeof(char), rlen, f);
+    luaL_addsize(&b, nr);
+    n -= nr;  /* still have to read `n' chars */
+    if (n == 0 || nr < rlen) break;  /* end of count or eof */
+    if (rlen <= ~(size_t)0 / 2) rlen *= 2;
+  }
+#else
   do {
     char *p = luaL_prepbuffer(&b);
     if (rlen > n) rlen = n;  /* cannot read more than asked */
@@ -326,6 +351,7 @@ static int read_chars (lua_State *L, FILE *f, size_t n) {
     luaL_addsize(&b, nr);
     n -= nr;  /* still have to read `n' chars */
   } while (n > 0 && nr == rlen);  /* until end of count or eof */
+#endif
   luaL_pushresult(&b);  /* close buffer */
   return (n == 0 || lua_objlen(L, -1) > 0);
 }
@@ -502,6 +528,7 @@ static const luaL_Reg flib[] = {
   {"setvbuf", f_setvbuf},
   {"write", f_write},
   {"__gc", io_gc},
+  {"__clone", io_clone},
   {"__tostring", io_tostring},
   {NULL, NULL}
 };
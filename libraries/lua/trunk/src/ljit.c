@@ -0,0 +1,856 @@
+/*
+** Native code for hot Lua functions (x86-64)
+** See Copyright Notice in lua.h
+*/
+
+
+#include <stddef.h>
+
+#define ljit_c
+#define LUA_CORE
+
+#include "lua.h"
+
+#include "ljit.h"
+
+#if defined(LUA_USE_JIT)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "lmem.h"
+#include "lopcodes.h"
+#include "ltm.h"
+#include "lgc.h"
+#include "lvm.h"
+
+
+
+/*
+** A function is compiled once, when it gets hot, into one block of
+** machine code with a piece for each instruction, plus a table with the
+** address of each piece so that `luaJ_run' can start at any instruction.
+** The pieces do what `luaV_execute' does for the common opcodes, with
+** fast paths for numbers and calls to the `luaV_' functions for the
+** rest. The other opcodes (calls, returns, creation of tables and
+** closures, etc.) make the native code return to the interpreter, which
+** runs them and then comes back (see `jitbreak' in lvm.c). A backward
+** jump also returns to the interpreter when a line or count hook is set.
+**
+** Registers: rbx = L, r12 = base, r13 = k, r14 = cl. Before a call that
+** may raise an error or run Lua code, `L->savedpc' is set as `Protect'
+** does; after it, r12 is reloaded (the stack may have moved).
+*/
+
+
+typedef int (*JitFunction) (lua_State *L, LClosure *cl, int pc);
+
+typedef struct JitCode {
+  size_t size;  /* size of the whole block */
+  JitFunction fn;  /* entry point */
+} JitCode;
+
+
+#define HEADER		32	/* space for the `JitCode' before the code */
+#define PROLOGUE	64	/* maximum size of prologue and exit */
+#define MAXPIECE	256	/* maximum size of the code of one instruction */
+#define MAXJUMPS	4	/* maximum jumps to other instructions in a piece */
+
+#define TT		cast_int(offsetof(TValue, tt))
+
+#define fnaddr(f)	cast(size_t, f)
+
+
+/* x86-64 registers */
+#define RAX	0
+#define RCX	1
+#define RDX	2
+#define RBX	3
+#define RSI	6
+#define RDI	7
+#define R8	8
+#define R12	12
+#define R13	13
+#define R14	14
+
+/* condition codes (a code xor 1 is its negation) */
+#define CC_B	0x2
+#define CC_AE	0x3
+#define CC_E	0x4
+#define CC_NE	0x5
+#define CC_BE	0x6
+#define CC_A	0x7
+#define CC_P	0xA
+#define CC_NONE	(-1)	/* unconditional jump */
+
+
+typedef struct JitState {
+  Proto *p;
+  unsigned char *code;  /* where the code goes */
+  size_t n;  /* bytes of code emitted */
+  size_t exit;  /* offset of the common exit */
+  int pc;  /* instruction being compiled */
+  int *offset;  /* offset of the piece of each instruction */
+  int *patchpos;  /* forward jumps to instructions (offset of rel32)... */
+  int *patchpc;  /* ...and their targets */
+  int npatch;
+} JitState;
+
+
+/* a TValue in memory: register r12 (stack) or r13 (constants) + disp */
+typedef struct Slot {
+  int base;
+  int disp;
+} Slot;
+
+
+static Slot slot (int base, int i) {
+  Slot s;
+  s.base = base;
+  s.disp = i * cast_int(sizeof(TValue));
+  return s;
+}
+
+#define reg(r)		slot(R12, r)
+#define kst(k)		slot(R13, k)
+#define rk(x)		(ISK(x) ? kst(INDEXK(x)) : reg(x))
+
+
+
+/*
+** {======================================================
+** Encoding of instructions
+** =======================================================
+*/
+
+static void byte (JitState *J, int b) {
+  J->code[J->n++] = cast(unsigned char, b);
+}
+
+
+static void dword (JitState *J, int d) {
+  unsigned int u = cast(unsigned int, d);
+  int i;
+  for (i = 0; i < 4; i++, u >>= 8) byte(J, u & 0xFF);
+}
+
+
+static void qword (JitState *J, size_t q) {
+  int i;
+  for (i = 0; i < 8; i++, q >>= 8) byte(J, cast_int(q & 0xFF));
+}
+
+
+static void rex (JitState *J, int w, int reg, int base) {
+  int r = 0x40 | (w << 3) | ((reg >> 3) << 2) | (base >> 3);
+  if (r != 0x40) byte(J, r);
+}
+
+
+/* ModRM (and SIB) for operand [base + disp32] */
+static void modrm (JitState *J, int reg, int base, int disp) {
+  byte(J, 0x80 | ((reg & 7) << 3) | (base & 7));
+  if ((base & 7) == 4) byte(J, 0x24);  /* r12 needs a SIB byte */
+  dword(J, disp);
+}
+
+
+/* `op reg, [base + disp]' (`w': 64-bit operation) */
+static void opmem (JitState *J, int w, int op, int reg, int base, int disp) {
+  rex(J, w, reg, base);
+  byte(J, op);
+  modrm(J, reg, base, disp);
+}
+
+
+/* SSE2 `prefix 0F op xmm, [base + disp]' */
+static void ssemem (JitState *J, int prefix, int op, int x, int base,
+                    int disp) {
+  byte(J, prefix);
+  rex(J, 0, x, base);
+  byte(J, 0x0F);
+  byte(J, op);
+  modrm(J, x, base, disp);
+}
+
+#define movsdload(J,x,s)	ssemem(J, 0xF2, 0x10, x, (s).base, (s).disp)
+#define movsdstore(J,x,s)	ssemem(J, 0xF2, 0x11, x, (s).base, (s).disp)
+#define ucomisd(J,x,s)		ssemem(J, 0x66, 0x2E, x, (s).base, (s).disp)
+
+
+static void movreg (JitState *J, int dst, int src) {
+  rex(J, 1, src, dst);
+  byte(J, 0x89);
+  byte(J, 0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+
+static void movimm (JitState *J, int reg, size_t imm) {
+  rex(J, 1, 0, reg);
+  byte(J, 0xB8 + (reg & 7));
+  qword(J, imm);
+}
+
+
+static void movimm32 (JitState *J, int reg, int imm) {
+  rex(J, 0, 0, reg);
+  byte(J, 0xB8 + (reg & 7));
+  dword(J, imm);
+}
+
+
+static void lea (JitState *J, int reg, Slot s) {
+  opmem(J, 1, 0x8D, reg, s.base, s.disp);
+}
+
+
+static void settt (JitState *J, Slot s, int tt) {
+  opmem(J, 0, 0xC7, 0, s.base, s.disp + TT);  /* mov dword [tt], imm32 */
+  dword(J, tt);
+}
+
+
+static void cmptt (JitState *J, Slot s, int tt) {
+  opmem(J, 0, 0x81, 7, s.base, s.disp + TT);  /* cmp dword [tt], imm32 */
+  dword(J, tt);
+}
+
+
+/* copies a TValue (`value' and `tt' as two quadwords) */
+static void copy (JitState *J, Slot to, Slot from) {
+  opmem(J, 1, 0x8B, RDX, from.base, from.disp);
+  opmem(J, 1, 0x8B, RCX, from.base, from.disp + 8);
+  opmem(J, 1, 0x89, RDX, to.base, to.disp);
+  opmem(J, 1, 0x89, RCX, to.base, to.disp + 8);
+}
+
+
+/* emits a jump with an empty rel32; returns the offset of the rel32 */
+static size_t jump (JitState *J, int cc) {
+  if (cc == CC_NONE)
+    byte(J, 0xE9);
+  else {
+    byte(J, 0x0F);
+    byte(J, 0x80 | cc);
+  }
+  dword(J, 0);
+  return J->n - 4;
+}
+
+
+static void patch (JitState *J, size_t pos, size_t to) {
+  size_t n = J->n;
+  J->n = pos;
+  dword(J, cast_int(to) - cast_int(pos + 4));
+  J->n = n;
+}
+
+#define here(J,pos)	patch(J, pos, (J)->n)
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Pieces of code
+** =======================================================
+*/
+
+/* goes back to the interpreter, to run instruction `pc' */
+static void leave (JitState *J, int pc) {
+  movimm32(J, RAX, pc);
+  patch(J, jump(J, CC_NONE), J->exit);
+}
+
+
+/* jumps to instruction `pc' (only if `cc' holds, unless CC_NONE) */
+static void jumpto (JitState *J, int cc, int pc) {
+  if (pc > J->pc) {  /* forward jump: patched at the end */
+    J->patchpos[J->npatch] = cast_int(jump(J, cc));
+    J->patchpc[J->npatch++] = pc;
+  }
+  else {  /* backward jump: leave if a hook was set meanwhile */
+    size_t skip = 0, nohook;
+    if (cc != CC_NONE) skip = jump(J, cc ^ 1);
+    opmem(J, 0, 0xF6, 0, RBX, offsetof(lua_State, hookmask));  /* test */
+    byte(J, LUA_MASKLINE | LUA_MASKCOUNT);
+    nohook = jump(J, CC_E);
+    leave(J, pc);
+    here(J, nohook);
+    patch(J, jump(J, CC_NONE), J->offset[pc]);
+    if (cc != CC_NONE) here(J, skip);
+  }
+}
+
+
+/* destination of the jump that follows a test */
+#define testtarget(J)	((J)->pc + 2 + GETARG_sBx((J)->p->code[(J)->pc + 1]))
+
+
+/* `L->savedpc = pc' before a call (as in `Protect') */
+static void savepc (JitState *J) {
+  movimm(J, RAX, cast(size_t, J->p->code + J->pc + 1));
+  opmem(J, 1, 0x89, RAX, RBX, offsetof(lua_State, savedpc));
+}
+
+
+/* calls `f' (arguments already in place) and reloads `base' */
+static void callf (JitState *J, size_t f) {
+  movimm(J, RAX, f);
+  byte(J, 0xFF);  /* call rax */
+  byte(J, 0xD0);
+  opmem(J, 1, 0x8B, R12, RBX, offsetof(lua_State, base));
+}
+
+
+/* checks that `x' (an RK operand) is a number; false if it cannot be */
+static int checknum (JitState *J, int x, size_t *slow, int *nslow) {
+  if (ISK(x))
+    return ttisnumber(&J->p->k[INDEXK(x)]);
+  cmptt(J, reg(x), LUA_TNUMBER);
+  slow[(*nslow)++] = jump(J, CC_NE);
+  return 1;
+}
+
+
+static void callarith (JitState *J, Slot ra, Slot rb, Slot rc, TMS op) {
+  savepc(J);
+  movreg(J, RDI, RBX);
+  lea(J, RSI, ra);
+  lea(J, RDX, rb);
+  lea(J, RCX, rc);
+  movimm32(J, R8, op);
+  callf(J, fnaddr(luaV_arith));
+}
+
+
+static void arith (JitState *J, Instruction i, int sseop, TMS op) {
+  Slot ra = reg(GETARG_A(i));
+  Slot rb = rk(GETARG_B(i));
+  Slot rc = rk(GETARG_C(i));
+  size_t slow[2], done = 0;
+  int nslow = 0, j;
+  if (checknum(J, GETARG_B(i), slow, &nslow) &&
+      checknum(J, GETARG_C(i), slow, &nslow)) {
+    movsdload(J, 0, rb);
+    ssemem(J, 0xF2, sseop, 0, rc.base, rc.disp);  /* op xmm0, RK(C) */
+    movsdstore(J, 0, ra);
+    settt(J, ra, LUA_TNUMBER);
+    done = jump(J, CC_NONE);
+  }
+  for (j = 0; j < nslow; j++) here(J, slow[j]);
+  callarith(J, ra, rb, rc, op);
+  if (done) here(J, done);
+}
+
+
+static void unm (JitState *J, Instruction i) {
+  Slot ra = reg(GETARG_A(i));
+  Slot rb = reg(GETARG_B(i));
+  size_t slow, done;
+  cmptt(J, rb, LUA_TNUMBER);
+  slow = jump(J, CC_NE);
+  opmem(J, 1, 0x8B, RAX, rb.base, rb.disp);
+  byte(J, 0x48); byte(J, 0x0F); byte(J, 0xBA); byte(J, 0xF8);  /* btc rax,63 */
+  byte(J, 63);
+  opmem(J, 1, 0x89, RAX, ra.base, ra.disp);
+  settt(J, ra, LUA_TNUMBER);
+  done = jump(J, CC_NONE);
+  here(J, slow);
+  callarith(J, ra, rb, rb, TM_UNM);
+  here(J, done);
+}
+
+
+static int equal (lua_State *L, const TValue *t1, const TValue *t2) {
+  return equalobj(L, t1, t2);
+}
+
+
+/* OP_EQ, OP_LT and OP_LE, with the OP_JMP that follows them */
+static void compare (JitState *J, Instruction i) {
+  Slot rb = rk(GETARG_B(i));
+  Slot rc = rk(GETARG_C(i));
+  OpCode op = GET_OPCODE(i);
+  size_t slow[2], done = 0;
+  int nslow = 0, j;
+  if (checknum(J, GETARG_B(i), slow, &nslow) &&
+      checknum(J, GETARG_C(i), slow, &nslow)) {
+    if (op == OP_EQ) {
+      movsdload(J, 0, rb);
+      ucomisd(J, 0, rc);
+      byte(J, 0x0F); byte(J, 0x94); byte(J, 0xC0);  /* sete al */
+      byte(J, 0x0F); byte(J, 0x9B); byte(J, 0xC1);  /* setnp cl */
+      byte(J, 0x20); byte(J, 0xC8);  /* and al, cl */
+    }
+    else {  /* `b < c' is `c > b' (false when unordered) */
+      movsdload(J, 0, rc);
+      ucomisd(J, 0, rb);
+      byte(J, 0x0F); byte(J, (op == OP_LT) ? 0x97 : 0x93);  /* seta/setae */
+      byte(J, 0xC0);
+    }
+    byte(J, 0x0F); byte(J, 0xB6); byte(J, 0xC0);  /* movzx eax, al */
+    done = jump(J, CC_NONE);
+  }
+  for (j = 0; j < nslow; j++) here(J, slow[j]);
+  savepc(J);
+  movreg(J, RDI, RBX);
+  lea(J, RSI, rb);
+  lea(J, RDX, rc);
+  callf(J, (op == OP_EQ) ? fnaddr(equal) :
+           (op == OP_LT) ? fnaddr(luaV_lessthan) : fnaddr(luaV_lessequal));
+  if (done) here(J, done);
+  byte(J, 0x85); byte(J, 0xC0);  /* test eax, eax */
+  jumpto(J, GETARG_A(i) ? CC_NE : CC_E, testtarget(J));
+  jumpto(J, CC_NONE, J->pc + 2);
+}
+
+
+/* eax = l_isfalse(s) */
+static void isfalse (JitState *J, Slot s) {
+  size_t isnil, notbool, istrue, done;
+  opmem(J, 0, 0x8B, RCX, s.base, s.disp + TT);  /* mov ecx, tt */
+  byte(J, 0x83); byte(J, 0xF9); byte(J, LUA_TNIL);  /* cmp ecx, imm8 */
+  isnil = jump(J, CC_E);
+  byte(J, 0x83); byte(J, 0xF9); byte(J, LUA_TBOOLEAN);
+  notbool = jump(J, CC_NE);
+  opmem(J, 0, 0x81, 7, s.base, s.disp);  /* cmp dword [value.b], 0 */
+  dword(J, 0);
+  istrue = jump(J, CC_NE);
+  here(J, isnil);
+  movimm32(J, RAX, 1);
+  done = jump(J, CC_NONE);
+  here(J, notbool);
+  here(J, istrue);
+  byte(J, 0x31); byte(J, 0xC0);  /* xor eax, eax */
+  here(J, done);
+}
+
+
+/* if (l_isfalse(eax) != c): compare eax with `c' */
+static void cmpeax (JitState *J, int c) {
+  byte(J, 0x83); byte(J, 0xF8); byte(J, c);  /* cmp eax, imm8 */
+}
+
+
+static void forloop (JitState *J, Instruction i) {
+  int a = GETARG_A(i);
+  size_t neg, cont, out1, out2;
+  movsdload(J, 0, reg(a));
+  ssemem(J, 0xF2, 0x58, 0, R12, reg(a+2).disp);  /* idx = xmm0 += step */
+  movsdload(J, 1, reg(a+1));  /* limit */
+  movsdload(J, 3, reg(a+2));  /* step */
+  byte(J, 0x0F); byte(J, 0x57); byte(J, 0xD2);  /* xorps xmm2, xmm2 */
+  byte(J, 0x66); byte(J, 0x0F); byte(J, 0x2E); byte(J, 0xDA);  /* ucomisd */
+  neg = jump(J, CC_BE);  /* not 0 < step? */
+  byte(J, 0x66); byte(J, 0x0F); byte(J, 0x2E); byte(J, 0xC8);  /* lim, idx */
+  cont = jump(J, CC_AE);  /* idx <= limit? */
+  out1 = jump(J, CC_NONE);
+  here(J, neg);
+  byte(J, 0x66); byte(J, 0x0F); byte(J, 0x2E); byte(J, 0xC1);  /* idx, lim */
+  out2 = jump(J, CC_B);  /* not limit <= idx? */
+  here(J, cont);
+  movsdstore(J, 0, reg(a));  /* update internal index... */
+  movsdstore(J, 0, reg(a+3));  /* ...and external index */
+  settt(J, reg(a+3), LUA_TNUMBER);
+  jumpto(J, CC_NONE, J->pc + 1 + GETARG_sBx(i));  /* jump back */
+  here(J, out1);
+  here(J, out2);
+}
+
+
+static void forprep (JitState *J, Instruction i) {
+  int a = GETARG_A(i);
+  size_t slow[3];
+  int j;
+  for (j = 0; j < 3; j++) {  /* all numbers? (else let the VM convert) */
+    cmptt(J, reg(a+j), LUA_TNUMBER);
+    slow[j] = jump(J, CC_NE);
+  }
+  movsdload(J, 0, reg(a));
+  ssemem(J, 0xF2, 0x5C, 0, R12, reg(a+2).disp);  /* subsd xmm0, step */
+  movsdstore(J, 0, reg(a));
+  jumpto(J, CC_NONE, J->pc + 1 + GETARG_sBx(i));
+  for (j = 0; j < 3; j++) here(J, slow[j]);
+  leave(J, J->pc);
+}
+
+
+static void getglobal (lua_State *L, LClosure *cl, StkId ra, TValue *key,
+                       int *cache) {
+  TValue g;
+  sethvalue(L, &g, cl->env);
+  luaV_getfield(L, &g, key, ra, cache);
+}
+
+
+static void setglobal (lua_State *L, LClosure *cl, TValue *key, StkId ra) {
+  TValue g;
+  sethvalue(L, &g, cl->env);
+  luaV_settable(L, &g, key, ra);
+}
+
+
+static void setupval (lua_State *L, LClosure *cl, int b, StkId ra) {
+  UpVal *uv = cl->upvals[b];
+  setobj(L, uv->v, ra);
+  luaC_barrier(L, uv, ra);
+}
+
+
+/*
+** leaves in rax the address of the entry of table R(t) for key RK(x) if
+** that key is an integer inside the array part; jumps to `slow' if not.
+** Returns false if RK(x) cannot be such a key.
+*/
+static int arrayslot (JitState *J, int t, int x, size_t *slow, int *nslow) {
+  Slot key = rk(x);
+  if (ISK(x)) {
+    const TValue *k = &J->p->k[INDEXK(x)];
+    int n;
+    if (!ttisnumber(k)) return 0;
+    lua_number2int(n, nvalue(k));
+    if (cast_num(n) != nvalue(k) || n < 1) return 0;
+    movimm32(J, RAX, n - 1);
+  }
+  else {
+    cmptt(J, key, LUA_TNUMBER);
+    slow[(*nslow)++] = jump(J, CC_NE);
+    ssemem(J, 0xF2, 0x2C, RAX, key.base, key.disp);  /* cvttsd2si */
+    byte(J, 0xF2); byte(J, 0x0F); byte(J, 0x2A); byte(J, 0xC0);  /* back */
+    ucomisd(J, 0, key);
+    slow[(*nslow)++] = jump(J, CC_NE);  /* not an integer? */
+    slow[(*nslow)++] = jump(J, CC_P);
+    byte(J, 0x83); byte(J, 0xE8); byte(J, 1);  /* sub eax, 1 */
+  }
+  cmptt(J, reg(t), LUA_TTABLE);
+  slow[(*nslow)++] = jump(J, CC_NE);
+  opmem(J, 1, 0x8B, RDX, R12, reg(t).disp);  /* rdx = hvalue(R(t)) */
+  opmem(J, 0, 0x3B, RAX, RDX, offsetof(Table, sizearray));
+  slow[(*nslow)++] = jump(J, CC_AE);  /* (unsigned) outside array part? */
+  opmem(J, 1, 0x8B, RDX, RDX, offsetof(Table, array));
+  byte(J, 0x48); byte(J, 0xC1); byte(J, 0xE0); byte(J, 4);  /* shl rax, 4 */
+  byte(J, 0x48); byte(J, 0x01); byte(J, 0xD0);  /* add rax, rdx */
+  return 1;
+}
+
+
+/* R(A) := R(B)[RK(C)] */
+static void gettable (JitState *J, int a, int b, int c) {
+  size_t slow[6], done = 0;
+  int nslow = 0, j;
+  if (arrayslot(J, b, c, slow, &nslow)) {
+    Slot v;
+    v.base = RAX;
+    v.disp = 0;
+    cmptt(J, v, LUA_TNIL);
+    slow[nslow++] = jump(J, CC_E);  /* absent keys may have `__index' */
+    copy(J, reg(a), v);
+    done = jump(J, CC_NONE);
+  }
+  for (j = 0; j < nslow; j++) here(J, slow[j]);
+  savepc(J);
+  movreg(J, RDI, RBX);
+  lea(J, RSI, reg(b));
+  lea(J, RDX, rk(c));
+  lea(J, RCX, reg(a));
+  if (ISK(c) && ttisstring(&J->p->k[INDEXK(c)])) {
+    movimm(J, R8, cast(size_t, J->p->cache + J->pc));
+    callf(J, fnaddr(luaV_getfield));
+  }
+  else
+    callf(J, fnaddr(luaV_gettable));
+  if (done) here(J, done);
+}
+
+
+/* R(A)[RK(B)] := RK(C) */
+static void settable (JitState *J, int a, int b, int c) {
+  size_t slow[7], done = 0;
+  int nslow = 0, j;
+  if (arrayslot(J, a, b, slow, &nslow)) {
+    Slot v;
+    v.base = RAX;
+    v.disp = 0;
+    cmptt(J, v, LUA_TNIL);
+    slow[nslow++] = jump(J, CC_E);  /* absent keys may have `__newindex' */
+    opmem(J, 1, 0x8B, RDX, R12, reg(a).disp);
+    opmem(J, 0, 0xF6, 0, RDX, offsetof(Table, marked));  /* test */
+    byte(J, bitmask(BLACKBIT));
+    slow[nslow++] = jump(J, CC_NE);  /* black table needs a barrier */
+    copy(J, v, rk(c));
+    done = jump(J, CC_NONE);
+  }
+  for (j = 0; j < nslow; j++) here(J, slow[j]);
+  savepc(J);
+  movreg(J, RDI, RBX);
+  lea(J, RSI, reg(a));
+  lea(J, RDX, rk(b));
+  lea(J, RCX, rk(c));
+  callf(J, fnaddr(luaV_settable));
+  if (done) here(J, done);
+}
+
+
+/*
+** emits the code of the current instruction; returns the number of
+** pseudo-instructions after it
+*/
+static int piece (JitState *J, Instruction i) {
+  int a = GETARG_A(i);
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: {
+      copy(J, reg(a), reg(b));
+      break;
+    }
+    case OP_LOADK: {
+      copy(J, reg(a), kst(GETARG_Bx(i)));
+      break;
+    }
+    case OP_LOADBOOL: {
+      opmem(J, 0, 0xC7, 0, R12, reg(a).disp);  /* value.b = b */
+      dword(J, b);
+      settt(J, reg(a), LUA_TBOOLEAN);
+      if (c) jumpto(J, CC_NONE, J->pc + 2);
+      break;
+    }
+    case OP_LOADNIL: {
+      if (b - a >= 16) leave(J, J->pc);  /* too long */
+      else {
+        for (; a <= b; a++) settt(J, reg(a), LUA_TNIL);
+      }
+      break;
+    }
+    case OP_GETUPVAL:
+    case OP_GETUINDEX: {
+      Slot v;
+      opmem(J, 1, 0x8B, RAX, R14, cast_int(offsetof(LClosure, upvals) +
+                                           b * sizeof(UpVal *)));
+      opmem(J, 1, 0x8B, RAX, RAX, offsetof(UpVal, v));
+      v.base = RAX;
+      v.disp = 0;
+      copy(J, reg(a), v);
+      break;
+    }
+    case OP_GETGLOBAL:
+    case OP_GETGINDEX: {
+      savepc(J);
+      movreg(J, RDI, RBX);
+      movreg(J, RSI, R14);
+      lea(J, RDX, reg(a));
+      lea(J, RCX, kst(GETARG_Bx(i)));
+      movimm(J, R8, cast(size_t, J->p->cache + J->pc));
+      callf(J, fnaddr(getglobal));
+      break;
+    }
+    case OP_GETTABLE:
+    case OP_GETTINDEX: {
+      gettable(J, a, b, c);
+      break;
+    }
+    case OP_SETGLOBAL: {
+      savepc(J);
+      movreg(J, RDI, RBX);
+      movreg(J, RSI, R14);
+      lea(J, RDX, kst(GETARG_Bx(i)));
+      lea(J, RCX, reg(a));
+      callf(J, fnaddr(setglobal));
+      break;
+    }
+    case OP_SETUPVAL: {
+      savepc(J);
+      movreg(J, RDI, RBX);
+      movreg(J, RSI, R14);
+      movimm32(J, RDX, b);
+      lea(J, RCX, reg(a));
+      callf(J, fnaddr(setupval));
+      break;
+    }
+    case OP_SETTABLE: {
+      settable(J, a, b, c);
+      break;
+    }
+    case OP_SELF: {
+      copy(J, reg(a+1), reg(b));
+      gettable(J, a, b, c);
+      break;
+    }
+    case OP_ADD: arith(J, i, 0x58, TM_ADD); break;
+    case OP_SUB: arith(J, i, 0x5C, TM_SUB); break;
+    case OP_MUL: arith(J, i, 0x59, TM_MUL); break;
+    case OP_DIV: arith(J, i, 0x5E, TM_DIV); break;
+    case OP_MOD: callarith(J, reg(a), rk(b), rk(c), TM_MOD); break;
+    case OP_POW: callarith(J, reg(a), rk(b), rk(c), TM_POW); break;
+    case OP_UNM: unm(J, i); break;
+    case OP_NOT: {
+      isfalse(J, reg(b));
+      opmem(J, 0, 0x89, RAX, R12, reg(a).disp);  /* value.b = eax */
+      settt(J, reg(a), LUA_TBOOLEAN);
+      break;
+    }
+    case OP_JMP: {
+      jumpto(J, CC_NONE, J->pc + 1 + GETARG_sBx(i));
+      break;
+    }
+    case OP_EQ:
+    case OP_LT:
+    case OP_LE: {
+      compare(J, i);
+      break;
+    }
+    case OP_TEST: {
+      isfalse(J, reg(a));
+      cmpeax(J, c);
+      jumpto(J, CC_NE, testtarget(J));
+      jumpto(J, CC_NONE, J->pc + 2);
+      break;
+    }
+    case OP_TESTSET: {
+      size_t skip;
+      isfalse(J, reg(b));
+      cmpeax(J, c);
+      skip = jump(J, CC_E);
+      copy(J, reg(a), reg(b));
+      jumpto(J, CC_NONE, testtarget(J));
+      here(J, skip);
+      jumpto(J, CC_NONE, J->pc + 2);
+      break;
+    }
+    case OP_FORLOOP: forloop(J, i); break;
+    case OP_FORPREP: forprep(J, i); break;
+    case OP_SETLIST: {
+      leave(J, J->pc);
+      return (c == 0);  /* real C in next `instruction'? */
+    }
+    case OP_CLOSURE: {
+      leave(J, J->pc);
+      return J->p->p[GETARG_Bx(i)]->nups;
+    }
+    default: {  /* left to the interpreter */
+      leave(J, J->pc);
+      break;
+    }
+  }
+  return 0;
+}
+
+/* }====================================================== */
+
+
+
+static void prologue (JitState *J, size_t *table) {
+  byte(J, 0x53);  /* push rbx */
+  byte(J, 0x41); byte(J, 0x54);  /* push r12 */
+  byte(J, 0x41); byte(J, 0x55);  /* push r13 */
+  byte(J, 0x41); byte(J, 0x56);  /* push r14 */
+  byte(J, 0x41); byte(J, 0x57);  /* push r15 (keeps the stack aligned) */
+  movreg(J, RBX, RDI);
+  movreg(J, R14, RSI);
+  opmem(J, 1, 0x8B, R12, RBX, offsetof(lua_State, base));
+  movimm(J, R13, cast(size_t, J->p->k));
+  byte(J, 0x48); byte(J, 0x63); byte(J, 0xD2);  /* movsxd rdx, edx */
+  byte(J, 0x48); byte(J, 0x8D); byte(J, 0x05);  /* lea rax, [rip + table] */
+  dword(J, 0);
+  *table = J->n - 4;
+  byte(J, 0xFF); byte(J, 0x24); byte(J, 0xD0);  /* jmp [rax + rdx*8] */
+  J->exit = J->n;  /* return eax */
+  byte(J, 0x41); byte(J, 0x5F);  /* pop r15 */
+  byte(J, 0x41); byte(J, 0x5E);  /* pop r14 */
+  byte(J, 0x41); byte(J, 0x5D);  /* pop r13 */
+  byte(J, 0x41); byte(J, 0x5C);  /* pop r12 */
+  byte(J, 0x5B);  /* pop rbx */
+  byte(J, 0xC3);  /* ret */
+}
+
+
+void luaJ_compile (lua_State *L, Proto *p) {
+  JitState J;
+  JitCode *jc;
+  unsigned char *block;
+  size_t size, used, table, page;
+  void **entry;
+  int n, skip;
+  p->ncalls = -1;  /* do not try again */
+  if (sizeof(TValue) != 16 || TT != 8)
+    return;  /* `copy' would not work */
+  J.offset = luaM_newvector(L, (2*MAXJUMPS + 1) * p->sizecode, int);
+  J.patchpos = J.offset + p->sizecode;
+  J.patchpc = J.patchpos + MAXJUMPS * p->sizecode;
+  size = HEADER + PROLOGUE + p->sizecode * (MAXPIECE + sizeof(void *));
+  block = cast(unsigned char *, mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (block != MAP_FAILED) {
+    J.p = p;
+    J.code = block + HEADER;
+    J.n = 0;
+    J.npatch = 0;
+    J.pc = 0;
+    prologue(&J, &table);
+    for (n = 0; n < p->sizecode; n++) {
+      J.pc = n;
+      J.offset[n] = cast_int(J.n);
+      skip = piece(&J, p->code[n]);
+      lua_assert(J.n - J.offset[n] <= MAXPIECE);
+      for (; skip > 0 && n + 1 < p->sizecode; skip--) {  /* never run */
+        n++;
+        J.offset[n] = J.offset[n - 1];
+      }
+    }
+    for (n = 0; n < J.npatch; n++)
+      patch(&J, J.patchpos[n], J.offset[J.patchpc[n]]);
+    while (J.n % sizeof(void *) != 0) byte(&J, 0xCC);  /* int3 */
+    patch(&J, table, J.n);
+    entry = cast(void **, J.code + J.n);
+    for (n = 0; n < p->sizecode; n++)
+      entry[n] = J.code + J.offset[n];
+    page = cast(size_t, sysconf(_SC_PAGESIZE));
+    used = HEADER + J.n + p->sizecode * sizeof(void *);
+    used = (used + page - 1) / page * page;
+    if (used < size)
+      munmap(block + used, size - used);  /* give back what was not used */
+    jc = cast(JitCode *, block);
+    jc->size = used;
+    jc->fn = cast(JitFunction, cast(size_t, J.code));
+    if (mprotect(block, used, PROT_READ | PROT_EXEC) == 0)
+      p->jit = jc;
+    else
+      munmap(block, used);
+  }
+  luaM_freearray(L, J.offset, (2*MAXJUMPS + 1) * p->sizecode, int);
+}
+
+
+const Instruction *luaJ_run (lua_State *L, LClosure *cl,
+                             const Instruction *pc) {
+  Proto *p = cl->p;
+  JitCode *jc = cast(JitCode *, p->jit);
+  return p->code + (*jc->fn)(L, cl, cast_int(pc - p->code));
+}
+
+
+void luaJ_free (Proto *p) {
+  if (p->jit != NULL)
+    munmap(p->jit, cast(JitCode *, p->jit)->size);
+}
+
+
+/*
+** Unmap the native code of all prototypes, for a `lua_close' that does
+** not free them one by one (see `bulkfree'). (The code pages are read
+** only, so the blocks cannot be linked among themselves; `rootgc' is
+** the list of them.)
+*/
+void luaJ_freeall (lua_State *L) {
+  GCObject *o;
+  for (o = G(L)->rootgc; o != NULL; o = o->gch.next) {
+    if (o->gch.tt == LUA_TPROTO) {
+      luaJ_free(gco2p(o));
+      gco2p(o)->jit = NULL;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,31 @@
+/*
+** Native code for hot Lua functions (x86-64)
+** See Copyright Notice in lua.h
+*/
+
+#ifndef ljit_h
+#define ljit_h
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+#if defined(LUA_USE_JIT)
+
+/* native code may run (it does not call line or count hooks) */
+#define luaJ_on(L)	(G(L)->jitthreshold >= 0 && \
+			 !((L)->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)))
+
+/* count a call to `p'; true when `p' must be compiled */
+#define luaJ_hot(L,p)	((p)->ncalls >= 0 && \
+			 ++(p)->ncalls > G(L)->jitthreshold)
+
+LUAI_FUNC void luaJ_compile (lua_State *L, Proto *p);
+LUAI_FUNC const Instruction *luaJ_run (lua_State *L, LClosure *cl,
+                                       const Instruction *pc);
+LUAI_FUNC void luaJ_free (Proto *p);
+LUAI_FUNC void luaJ_freeall (lua_State *L);
+
+#endif
+
+#endif
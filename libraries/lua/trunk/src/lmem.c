@@ -70,12 +70,203 @@ void *luaM_toobig (lua_State *L) {
 
 
 
+/*
+** {======================================================
+** Background freeing
+** =======================================================
+*/
+
+#if defined(LUA_USE_BGSWEEP)
+
+#include <pthread.h>
+
+/*
+** While background freeing is on, blocks released by Lua (mostly by the
+** sweep phases of the collector) are not given back to the allocator
+** at once: `luaM_realloc_' updates `totalbytes' as usual and queues the
+** block in a batch. Full batches are freed by a helper thread, which
+** calls the allocator concurrently with the main thread, so it only
+** starts if the host declared the allocator thread safe (with
+** `lua_setallocsafe', as `luaL_newstate' does).
+*/
+
+#define FREEBATCH	1024  /* blocks in a batch */
+#define MAXBATCHES	64  /* queued batches before freeing in place */
+
+typedef struct FreeBatch {
+  struct FreeBatch *next;
+  int n;
+  struct {
+    void *block;
+    size_t size;
+  } b[FREEBATCH];
+} FreeBatch;
+
+
+struct BGFree {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  FreeBatch *queue;  /* batches to be freed */
+  FreeBatch **last;  /* end of `queue' */
+  FreeBatch *spare;  /* free batches */
+  FreeBatch *current;  /* batch being filled by the main thread */
+  int nbatches;  /* number of batches created */
+  int stop;
+  lua_Alloc frealloc;
+  void *ud;
+};
+
+
+static void *freerthread (void *ud) {
+  BGFree *bg = cast(BGFree *, ud);
+  pthread_mutex_lock(&bg->lock);
+  for (;;) {
+    FreeBatch *fb;
+    int i;
+    while (bg->queue == NULL && !bg->stop)
+      pthread_cond_wait(&bg->cond, &bg->lock);
+    if (bg->queue == NULL) break;  /* stopped and nothing left to do */
+    fb = bg->queue;
+    bg->queue = fb->next;
+    if (bg->queue == NULL) bg->last = &bg->queue;
+    pthread_mutex_unlock(&bg->lock);
+    for (i = 0; i < fb->n; i++)
+      (*bg->frealloc)(bg->ud, fb->b[i].block, fb->b[i].size, 0);
+    fb->n = 0;
+    pthread_mutex_lock(&bg->lock);
+    fb->next = bg->spare;
+    bg->spare = fb;
+  }
+  pthread_mutex_unlock(&bg->lock);
+  return NULL;
+}
+
+
+static void submitbatch (BGFree *bg) {
+  FreeBatch *fb = bg->current;
+  bg->current = NULL;
+  fb->next = NULL;
+  pthread_mutex_lock(&bg->lock);
+  *bg->last = fb;
+  bg->last = &fb->next;
+  pthread_cond_signal(&bg->cond);
+  pthread_mutex_unlock(&bg->lock);
+}
+
+
+static void deferfree (BGFree *bg, void *block, size_t size) {
+  FreeBatch *fb = bg->current;
+  if (fb == NULL) {  /* get a new batch */
+    pthread_mutex_lock(&bg->lock);
+    fb = bg->spare;
+    if (fb != NULL) bg->spare = fb->next;
+    pthread_mutex_unlock(&bg->lock);
+    if (fb == NULL && bg->nbatches < MAXBATCHES) {
+      fb = cast(FreeBatch *, (*bg->frealloc)(bg->ud, NULL, 0,
+                                             sizeof(FreeBatch)));
+      if (fb != NULL) {
+        bg->nbatches++;
+        fb->n = 0;
+      }
+    }
+    if (fb == NULL) {  /* helper thread is behind (or no memory)? */
+      (*bg->frealloc)(bg->ud, block, size, 0);  /* free it here */
+      return;
+    }
+    bg->current = fb;
+  }
+  fb->b[fb->n].block = block;
+  fb->b[fb->n].size = size;
+  if (++fb->n == FREEBATCH)
+    submitbatch(bg);
+}
+
+
+void luaM_flushfree (lua_State *L) {
+  BGFree *bg = G(L)->bgfree;
+  if (bg != NULL && bg->current != NULL)
+    submitbatch(bg);
+}
+
+
+int luaM_setbgfree (lua_State *L, int on) {
+  global_State *g = G(L);
+  BGFree *bg = g->bgfree;
+  int res = (bg != NULL);
+  if (on && bg == NULL) {
+    if (!g->allocsafe)  /* allocator not declared thread safe? */
+      return -1;
+    bg = cast(BGFree *, (*g->frealloc)(g->ud, NULL, 0, sizeof(BGFree)));
+    if (bg == NULL) return -1;
+    bg->queue = bg->spare = bg->current = NULL;
+    bg->last = &bg->queue;
+    bg->nbatches = 0;
+    bg->stop = 0;
+    bg->frealloc = g->frealloc;
+    bg->ud = g->ud;
+    pthread_mutex_init(&bg->lock, NULL);
+    pthread_cond_init(&bg->cond, NULL);
+    if (pthread_create(&bg->thread, NULL, freerthread, bg) != 0) {
+      pthread_cond_destroy(&bg->cond);
+      pthread_mutex_destroy(&bg->lock);
+      (*g->frealloc)(g->ud, bg, sizeof(BGFree), 0);
+      return -1;
+    }
+    g->bgfree = bg;
+  }
+  else if (!on && bg != NULL) {
+    g->bgfree = NULL;
+    if (bg->current != NULL)
+      submitbatch(bg);
+    pthread_mutex_lock(&bg->lock);
+    bg->stop = 1;
+    pthread_cond_signal(&bg->cond);
+    pthread_mutex_unlock(&bg->lock);
+    pthread_join(bg->thread, NULL);  /* thread empties the queue first */
+    while (bg->spare != NULL) {
+      FreeBatch *fb = bg->spare;
+      bg->spare = fb->next;
+      (*g->frealloc)(g->ud, fb, sizeof(FreeBatch), 0);
+    }
+    pthread_cond_destroy(&bg->cond);
+    pthread_mutex_destroy(&bg->lock);
+    (*g->frealloc)(g->ud, bg, sizeof(BGFree), 0);
+  }
+  return res;
+}
+
+#else
+
+void luaM_flushfree (lua_State *L) {
+  UNUSED(L);
+}
+
+
+int luaM_setbgfree (lua_State *L, int on) {
+  UNUSED(L);
+  return on ? -1 : 0;  /* not available */
+}
+
+#endif
+
+/* }====================================================== */
+
+
+
 /*
 ** generic allocation routine.
 */
 void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   global_State *g = G(L);
   lua_assert((osize == 0) == (block == NULL));
+#if defined(LUA_USE_BGSWEEP)
+  if (nsize == 0 && g->bgfree != NULL && block != NULL) {
+    deferfree(g->bgfree, block, osize);
+    g->totalbytes -= osize;
+    return NULL;
+  }
+#endif
   block = (*g->frealloc)(g->ud, block, osize, nsize);
   if (block == NULL && nsize > 0)
     luaD_throw(L, LUA_ERRMEM);
@@ -291,6 +291,16 @@ static int gctm (lua_State *L) {
 }
 
 
+/*
+** called by `lua_clonestate' for the copy of a library handle: only the
+** template unloads the library, so it must outlive clones that use it
+*/
+static int ll_clone (lua_State *L) {
+  *(void **)lua_touserdata(L, 1) = NULL;
+  return 0;
+}
+
+
 static int ll_loadfunc (lua_State *L, const char *path, const char *sym) {
   void **reg = ll_register(L, path);
   if (*reg == NULL) *reg = ll_load(L, path);
@@ -630,6 +640,8 @@ LUALIB_API int luaopen_package (lua_State *L) {
   luaL_newmetatable(L, "_LOADLIB");
   lua_pushcfunction(L, gctm);
   lua_setfield(L, -2, "__gc");
+  lua_pushcfunction(L, ll_clone);
+  lua_setfield(L, -2, "__clone");
   /* create `package' table */
   luaL_register(L, LUA_LOADLIBNAME, pk_funcs);
 #if defined(LUA_COMPAT_LOADLIB) 
@@ -75,11 +75,13 @@ int luaO_rawequalObj (const TValue *t1, const TValue *t2) {
     case LUA_TNIL:
       return 1;
     case LUA_TNUMBER:
-      return luai_numeq(nvalue(t1), nvalue(t2));
+      return luaO_numeq(t1, t2);
     case LUA_TBOOLEAN:
       return bvalue(t1) == bvalue(t2);  /* boolean true must be 1 !! */
     case LUA_TLIGHTUSERDATA:
       return pvalue(t1) == pvalue(t2);
+    case LUA_TSTRING:
+      return luaS_eqstr(rawtsvalue(t1), rawtsvalue(t2));
     default:
       lua_assert(iscollectable(t1));
       return gcvalue(t1) == gcvalue(t2);
@@ -87,6 +89,45 @@ int luaO_rawequalObj (const TValue *t1, const TValue *t2) {
 }
 
 
+#if defined(LUAI_INTSUBTYPE)
+
+/*
+** equality of numbers; integers are compared exactly, also with doubles:
+** a double equals an integer only when it is integral, inside the range
+** of lua_Integer and converts to that integer (so equality is transitive)
+*/
+int luaO_numeq (const TValue *t1, const TValue *t2) {
+  if (ttisint(t1) && ttisint(t2))
+    return ivalue(t1) == ivalue(t2);
+  else if (ttisint(t1) || ttisint(t2)) {
+    lua_Integer i = ttisint(t1) ? ivalue(t1) : ivalue(t2);
+    lua_Number n = ttisint(t1) ? nvalue(t2) : nvalue(t1);
+    lua_Number lim = luai_numadd(MAXINTFIT, MAXINTFIT);
+    if (luai_numlt(n, luai_numunm(lim)) || !luai_numlt(n, lim))
+      return 0;  /* out of range (or NaN) */
+    return luai_numeq(cast_num(cast(lua_Integer, n)), n) &&
+           cast(lua_Integer, n) == i;
+  }
+  else
+    return luai_numeq(nvalue(t1), nvalue(t2));
+}
+
+
+/*
+** sets a number constant, as an integer when that keeps its value (not
+** for -0, as integers have no sign of zero)
+*/
+void luaO_setnumber (TValue *o, lua_Number n) {
+  if (numfitsint(n) && luai_numeq(cast_num(cast(lua_Integer, n)), n) &&
+      (!luai_numeq(n, 0) || luai_numlt(0, luai_numdiv(1, n))))
+    setivalue(o, cast(lua_Integer, n))
+  else
+    setnvalue(o, n);
+}
+
+#endif
+
+
 int luaO_str2d (const char *s, lua_Number *result) {
   char *endptr;
   *result = lua_str2number(s, &endptr);
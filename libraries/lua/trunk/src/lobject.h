@@ -29,6 +29,12 @@
 #define LUA_TUPVAL	(LAST_TAG+2)
 #define LUA_TDEADKEY	(LAST_TAG+3)
 
+/*
+** integers are a variant of numbers (see LUAI_INTSUBTYPE): their tag has
+** an extra bit, which `ttype' ignores
+*/
+#define LUA_TINT	(LUA_TNUMBER | 0x10)
+
 
 /*
 ** Union of all collectable objects
@@ -61,6 +67,9 @@ typedef union {
   void *p;
   lua_Number n;
   int b;
+#if defined(LUAI_INTSUBTYPE)
+  lua_Integer i;
+#endif
 } Value;
 
 
@@ -87,10 +96,20 @@ typedef struct lua_TValue {
 #define ttislightuserdata(o)	(ttype(o) == LUA_TLIGHTUSERDATA)
 
 /* Macros to access values */
+#if defined(LUAI_INTSUBTYPE)
+#define ttype(o)	((o)->tt & 0x0F)
+#define ttisint(o)	((o)->tt == LUA_TINT)
+#define ivalue(o)	check_exp(ttisint(o), (o)->value.i)
+#define nvalue(o)	check_exp(ttisnumber(o), \
+	(ttisint(o) ? cast_num((o)->value.i) : (o)->value.n))
+#else
 #define ttype(o)	((o)->tt)
+#define ttisint(o)	0
+#define ivalue(o)	cast(lua_Integer, nvalue(o))
+#define nvalue(o)	check_exp(ttisnumber(o), (o)->value.n)
+#endif
 #define gcvalue(o)	check_exp(iscollectable(o), (o)->value.gc)
 #define pvalue(o)	check_exp(ttislightuserdata(o), (o)->value.p)
-#define nvalue(o)	check_exp(ttisnumber(o), (o)->value.n)
 #define rawtsvalue(o)	check_exp(ttisstring(o), &(o)->value.gc->ts)
 #define tsvalue(o)	(&rawtsvalue(o)->tsv)
 #define rawuvalue(o)	check_exp(ttisuserdata(o), &(o)->value.gc->u)
@@ -119,6 +138,13 @@ typedef struct lua_TValue {
 #define setnvalue(obj,x) \
   { TValue *i_o=(obj); i_o->value.n=(x); i_o->tt=LUA_TNUMBER; }
 
+#if defined(LUAI_INTSUBTYPE)
+#define setivalue(obj,x) \
+  { TValue *i_o=(obj); i_o->value.i=(x); i_o->tt=LUA_TINT; }
+#else
+#define setivalue(obj,x)	setnvalue(obj, cast_num(x))
+#endif
+
 #define setpvalue(obj,x) \
   { TValue *i_o=(obj); i_o->value.p=(x); i_o->tt=LUA_TLIGHTUSERDATA; }
 
@@ -183,7 +209,7 @@ typedef struct lua_TValue {
 #define setobj2n	setobj
 #define setsvalue2n	setsvalue
 
-#define setttype(obj, tt) (ttype(obj) = (tt))
+#define setttype(obj, t) ((obj)->tt = (t))
 
 
 #define iscollectable(o)	(ttype(o) >= LUA_TSTRING)
@@ -201,13 +227,32 @@ typedef union TString {
   struct {
     CommonHeader;
     lu_byte reserved;
+    lu_byte kind;  /* bits LNGSTR, STRHASHED, EXTSTR */
     unsigned int hash;
     size_t len;
   } tsv;
 } TString;
 
 
-#define getstr(ts)	cast(const char *, (ts) + 1)
+/* bits in field `kind' of strings */
+#define LNGSTR		1  /* not interned (see lstring.c) */
+#define STRHASHED	2  /* `hash' is computed (short strings always are) */
+#define EXTSTR		4  /* contents are not in the string object */
+
+
+/*
+** External strings keep, after their TString, where their contents are
+*/
+typedef struct ExtString {
+  const char *s;
+  lua_ExtFree freefn;  /* releases `s' (may be NULL) */
+  void *ud;
+} ExtString;
+
+
+#define extstr(ts)	cast(ExtString *, (ts) + 1)
+#define getstr(ts)	(((ts)->tsv.kind & EXTSTR) ? extstr(ts)->s : \
+                                          cast(const char *, (ts) + 1))
 #define svalue(o)       getstr(rawtsvalue(o))
 
 
@@ -232,6 +277,7 @@ typedef struct Proto {
   CommonHeader;
   TValue *k;  /* constants used by the function */
   Instruction *code;
+  int *cache;  /* inline caches of field accesses (one for each opcode) */
   struct Proto **p;  /* functions defined inside the function */
   int *lineinfo;  /* map from opcodes to source lines */
   struct LocVar *locvars;  /* information about local variables */
@@ -250,6 +296,10 @@ typedef struct Proto {
   lu_byte numparams;
   lu_byte is_vararg;
   lu_byte maxstacksize;
+#if defined(LUA_USE_JIT)
+  void *jit;  /* native code (NULL if not compiled) */
+  int ncalls;  /* calls so far (-1 once compiled or given up) */
+#endif
 } Proto;
 
 
@@ -323,7 +373,9 @@ typedef union Closure {
 typedef union TKey {
   struct {
     TValuefields;
+#if !defined(LUAI_OPENHASH)
     struct Node *next;  /* for chaining */
+#endif
   } nk;
   TValue tvk;
 } TKey;
@@ -342,7 +394,11 @@ typedef struct Table {
   struct Table *metatable;
   TValue *array;  /* array part */
   Node *node;
+#if !defined(LUAI_OPENHASH)
   Node *lastfree;  /* any free position is before this position */
+#else
+  int nfree;  /* number of keys that still fit in `node' */
+#endif
   GCObject *gclist;
   int sizearray;  /* size of `array' array */
 } Table;
@@ -360,6 +416,19 @@ typedef struct Table {
 #define sizenode(t)	(twoto((t)->lsizenode))
 
 
+#if defined(LUAI_INTSUBTYPE)
+/*
+** numbers with absolute value below `MAXINTFIT' convert to lua_Integer
+** without overflow, with one bit to spare; so, when the result of an
+** operation over integers is in this range as a double, the operation
+** over the integers does not overflow either
+*/
+#define MAXINTFIT \
+	cast_num(cast(lua_Integer, 1) << (sizeof(lua_Integer)*CHAR_BIT - 2))
+#define numfitsint(n)	(luai_numlt(-MAXINTFIT, (n)) && luai_numlt((n), MAXINTFIT))
+#endif
+
+
 #define luaO_nilobject		(&luaO_nilobject_)
 
 LUAI_DATA const TValue luaO_nilobject_;
@@ -370,6 +439,13 @@ LUAI_FUNC int luaO_log2 (unsigned int x);
 LUAI_FUNC int luaO_int2fb (unsigned int x);
 LUAI_FUNC int luaO_fb2int (int x);
 LUAI_FUNC int luaO_rawequalObj (const TValue *t1, const TValue *t2);
+#if defined(LUAI_INTSUBTYPE)
+LUAI_FUNC int luaO_numeq (const TValue *t1, const TValue *t2);
+LUAI_FUNC void luaO_setnumber (TValue *o, lua_Number n);
+#else
+#define luaO_numeq(t1,t2)	luai_numeq(nvalue(t1), nvalue(t2))
+#define luaO_setnumber(o,n)	setnvalue(o, n)
+#endif
 LUAI_FUNC int luaO_str2d (const char *s, lua_Number *result);
 LUAI_FUNC const char *luaO_pushvfstring (lua_State *L, const char *fmt,
                                                        va_list argp);
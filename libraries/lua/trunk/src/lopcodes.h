@@ -204,11 +204,15 @@ OP_SETLIST,/*	A B C	R(A)[(C-1)*FPF+i] := R(A+i), 1 <= i <= B	*/
 OP_CLOSE,/*	A 	close all variables in the stack up to (>=) R(A)*/
 OP_CLOSURE,/*	A Bx	R(A) := closure(KPROTO[Bx], R(A), ... ,R(A+n))	*/
 
-OP_VARARG/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
+OP_VARARG,/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
+
+OP_GETGINDEX,/*	A Bx	R(A) := Gbl[Kst(Bx)]; then next GETTABLE	*/
+OP_GETUINDEX,/*	A B	R(A) := UpValue[B]; then next GETTABLE		*/
+OP_GETTINDEX/*	A B C	R(A) := R(B)[RK(C)]; then next GETTABLE		*/
 } OpCode;
 
 
-#define NUM_OPCODES	(cast(int, OP_VARARG) + 1)
+#define NUM_OPCODES	(cast(int, OP_GETTINDEX) + 1)
 
 
 
@@ -230,6 +234,10 @@ OP_VARARG/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
       (true or false).
 
   (*) All `skips' (pc++) assume that next instruction is a jump
+
+  (*) OP_GETGINDEX, OP_GETUINDEX and OP_GETTINDEX are OP_GETGLOBAL,
+      OP_GETUPVAL and OP_GETTABLE that also execute the next instruction,
+      an OP_GETTABLE X A Y indexing their result, in the same dispatch
 ===========================================================================*/
 
 
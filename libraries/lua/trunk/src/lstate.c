@@ -6,6 +6,7 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #define lstate_c
 #define LUA_CORE
@@ -16,6 +17,7 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "llex.h"
 #include "lmem.h"
 #include "lstate.h"
@@ -40,14 +42,26 @@ typedef struct LG {
 
 
 static void stack_init (lua_State *L1, lua_State *L) {
-  /* initialize CallInfo array */
-  L1->base_ci = luaM_newvector(L, BASIC_CI_SIZE, CallInfo);
+  global_State *g = G(L);
+  if (g->nspare > 0) {  /* reuse the arrays of a dead thread */
+    SpareStack *s = &g->spare[--g->nspare];
+    L1->base_ci = s->ci;
+    L1->size_ci = s->size_ci;
+    L1->stack = s->stack;
+    L1->stacksize = s->stacksize;
+  }
+  else {
+    /* initialize CallInfo array */
+    L1->base_ci = luaM_newvector(L, g->threadci, CallInfo);
+    L1->size_ci = g->threadci;
+    /* initialize stack array */
+    L1->stack = luaM_newvector(L, g->threadstack, TValue);
+    L1->stacksize = g->threadstack;
+  }
+  L1->minci = g->threadci;
+  L1->minstack = g->threadstack;
   L1->ci = L1->base_ci;
-  L1->size_ci = BASIC_CI_SIZE;
   L1->end_ci = L1->base_ci + L1->size_ci - 1;
-  /* initialize stack array */
-  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, TValue);
-  L1->stacksize = BASIC_STACK_SIZE + EXTRA_STACK;
   L1->top = L1->stack;
   L1->stack_last = L1->stack+(L1->stacksize - EXTRA_STACK)-1;
   /* initialize first ci */
@@ -64,6 +78,36 @@ static void freestack (lua_State *L, lua_State *L1) {
 }
 
 
+/* arrays of `s' are not too small nor too big for a new thread? */
+#define fitspool(g,s,n) \
+	((g)->threadstack <= (s) && (s) <= 2*(g)->threadstack && \
+	 (g)->threadci <= (n) && (n) <= 2*(g)->threadci)
+
+
+/*
+** Keeps up to `n' stacks of dead threads for new threads, which start
+** with `stacksize' stack slots and `size_ci' CallInfo entries.
+*/
+void luaE_setstackpool (lua_State *L, int n, int stacksize, int size_ci) {
+  global_State *g = G(L);
+  int i, j;
+  g->threadstack = stacksize;
+  g->threadci = size_ci;
+  for (i = j = 0; i < g->nspare; i++) {  /* drop stacks that do not fit */
+    SpareStack *s = &g->spare[i];
+    if (j < n && fitspool(g, s->stacksize, s->size_ci))
+      g->spare[j++] = *s;
+    else {
+      luaM_freearray(L, s->ci, s->size_ci, CallInfo);
+      luaM_freearray(L, s->stack, s->stacksize, TValue);
+    }
+  }
+  g->nspare = j;
+  luaM_reallocvector(L, g->spare, g->maxspare, n, SpareStack);
+  g->maxspare = n;
+}
+
+
 /*
 ** open parts that may cause memory-allocation errors
 */
@@ -93,6 +137,7 @@ static void preinit_state (lua_State *L, global_State *g) {
   resethookcount(L);
   L->openupval = NULL;
   L->size_ci = 0;
+  L->minstack = L->minci = 0;
   L->nCcalls = L->baseCcalls = 0;
   L->status = 0;
   L->base_ci = L->ci = NULL;
@@ -104,14 +149,24 @@ static void preinit_state (lua_State *L, global_State *g) {
 
 static void close_state (lua_State *L) {
   global_State *g = G(L);
-  luaF_close(L, L->stack);  /* close all upvalues for this thread */
-  luaC_freeall(L);  /* collect all objects */
-  lua_assert(g->rootgc == obj2gco(L));
-  lua_assert(g->strt.nuse == 0);
-  luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size, TString *);
-  luaZ_freebuffer(L, &g->buff);
-  freestack(L, L);
-  lua_assert(g->totalbytes == sizeof(LG));
+  luaM_setbgfree(L, 0);  /* wait for pending frees */
+  if (!g->bulkfree) {  /* else allocator releases everything at once */
+    luaF_close(L, L->stack);  /* close all upvalues for this thread */
+    luaC_freeall(L);  /* collect all objects */
+    lua_assert(g->rootgc == obj2gco(L));
+    lua_assert(g->strt.nuse == 0);
+    luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size, TString *);
+    luaZ_freebuffer(L, &g->buff);
+    luaE_setstackpool(L, 0, g->threadstack, g->threadci);
+    freestack(L, L);
+    lua_assert(g->totalbytes == sizeof(LG));
+  }
+  else {  /* objects go with the arena, but not what they keep outside */
+    luaS_freeallext(L);
+#if defined(LUA_USE_JIT)
+    luaJ_freeall(L);
+#endif
+  }
   (*g->frealloc)(g->ud, fromstate(L), state_size(LG), 0);
 }
 
@@ -135,11 +190,57 @@ void luaE_freethread (lua_State *L, lua_State *L1) {
   luaF_close(L1, L1->stack);  /* close all upvalues for this thread */
   lua_assert(L1->openupval == NULL);
   luai_userstatefree(L1);
-  freestack(L, L1);
+  if (G(L)->nspare < G(L)->maxspare &&
+      fitspool(G(L), L1->stacksize, L1->size_ci)) {  /* keep its arrays */
+    SpareStack *s = &G(L)->spare[G(L)->nspare++];
+    s->stack = L1->stack;
+    s->stacksize = L1->stacksize;
+    s->ci = L1->base_ci;
+    s->size_ci = L1->size_ci;
+  }
+  else
+    freestack(L, L1);
   luaM_freemem(L, fromstate(L1), state_size(lua_State));
 }
 
 
+#if defined(LUA_USE_LOCK)
+
+#include <sched.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define futex(a,op,v)	syscall(SYS_futex, (a), (op), (v), NULL, NULL, 0)
+
+/*
+** `lua_lock' and `lua_unlock' (see luaconf.h) handle a lock without
+** contention; these functions handle the rest, as in the third mutex of
+** "Futexes Are Tricky" (U. Drepper).
+*/
+void luaE_lock (lua_State *L) {
+  volatile int *lock = &G(L)->lock;
+  while (__sync_lock_test_and_set(lock, 2) != 0)  /* still taken? */
+    futex(lock, FUTEX_WAIT_PRIVATE, 2);  /* sleep while it is 2 */
+}
+
+
+void luaE_unlock (lua_State *L) {  /* there may be waiters */
+  volatile int *lock = &G(L)->lock;
+  __sync_lock_release(lock);
+  futex(lock, FUTEX_WAKE_PRIVATE, 1);
+}
+
+
+void luaE_yield (lua_State *L) {  /* let a waiting thread run */
+  lua_unlock(L);
+  sched_yield();
+  lua_lock(L);
+}
+
+#endif
+
+
 LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   int i;
   lua_State *L;
@@ -156,6 +257,7 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   preinit_state(L, g);
   g->frealloc = f;
   g->ud = ud;
+  g->seed = luai_makeseed(L);
   g->mainthread = L;
   g->uvhead.u.l.prev = &g->uvhead;
   g->uvhead.u.l.next = &g->uvhead;
@@ -167,6 +269,9 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   luaZ_initbuffer(L, &g->buff);
   g->panic = NULL;
   g->gcstate = GCSpause;
+  g->gckind = KGC_NORMAL;
+  g->bulkfree = 0;
+  g->allocsafe = 0;
   g->rootgc = obj2gco(L);
   g->sweepstrgc = 0;
   g->sweepgc = &g->rootgc;
@@ -177,7 +282,21 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->totalbytes = sizeof(LG);
   g->gcpause = LUAI_GCPAUSE;
   g->gcstepmul = LUAI_GCMUL;
+#if defined(LUA_USE_JIT)
+  g->jitthreshold = LUAI_JITTHRESHOLD;
+#endif
   g->gcdept = 0;
+  g->lastmajor = 0;
+  g->gcfreed = 0;
+  g->bgfree = NULL;
+  g->spare = NULL;
+  g->nspare = g->maxspare = 0;
+  g->threadstack = BASIC_STACK_SIZE + EXTRA_STACK;
+  g->threadci = BASIC_CI_SIZE;
+#if defined(LUA_USE_LOCK)
+  g->lock = 0;
+#endif
+  memset(&g->gcstats, 0, sizeof(g->gcstats));
   for (i=0; i<NUM_TAGS; i++) g->mt[i] = NULL;
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != 0) {
     /* memory allocation error: free partial state */
@@ -16,6 +16,7 @@
 
 
 struct lua_longjmp;  /* defined in ldo.c */
+typedef struct BGFree BGFree;  /* defined in lmem.c */
 
 
 /* table of globals */
@@ -55,6 +56,17 @@ typedef struct CallInfo {
 } CallInfo;
 
 
+/*
+** stack and CallInfo array of a dead thread, kept for a new one
+*/
+typedef struct SpareStack {
+  TValue *stack;
+  CallInfo *ci;
+  int stacksize;
+  int size_ci;
+} SpareStack;
+
+
 
 #define curr_func(L)	(clvalue(L->ci->func))
 #define ci_func(ci)	(clvalue((ci)->func))
@@ -67,10 +79,14 @@ typedef struct CallInfo {
 */
 typedef struct global_State {
   stringtable strt;  /* hash table for strings */
+  unsigned int seed;  /* randomized seed for string hashes */
   lua_Alloc frealloc;  /* function to reallocate memory */
   void *ud;         /* auxiliary data to `frealloc' */
   lu_byte currentwhite;
   lu_byte gcstate;  /* state of garbage collector */
+  lu_byte gckind;  /* kind of GC running */
+  lu_byte bulkfree;  /* allocator frees all memory along with the state */
+  lu_byte allocsafe;  /* allocator may be called from other threads */
   int sweepstrgc;  /* position of sweep in `strt' */
   GCObject *rootgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* position of sweep in `rootgc' */
@@ -83,8 +99,23 @@ typedef struct global_State {
   lu_mem totalbytes;  /* number of bytes currently allocated */
   lu_mem estimate;  /* an estimate of number of bytes actually in use */
   lu_mem gcdept;  /* how much GC is `behind schedule' */
+  lu_mem lastmajor;  /* `estimate' after last major collection (gen. mode) */
+  lu_mem gcfreed;  /* bytes freed in current cycle */
+  lua_GCStats gcstats;  /* collector statistics */
+  BGFree *bgfree;  /* background freeing (NULL when off) */
+  SpareStack *spare;  /* pool of stacks for new threads */
+  int nspare;  /* number of stacks in `spare' */
+  int maxspare;  /* size of `spare' */
+  int threadstack;  /* stack size of new threads */
+  int threadci;  /* size of the CallInfo array of new threads */
+#if defined(LUA_USE_LOCK)
+  volatile int lock;  /* 0: free; 1: taken; 2: taken, maybe with waiters */
+#endif
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC `granularity' */
+#if defined(LUA_USE_JIT)
+  int jitthreshold;  /* calls before compiling a function (< 0: no JIT) */
+#endif
   lua_CFunction panic;  /* to be called in unprotected errors */
   TValue l_registry;
   struct lua_State *mainthread;
@@ -111,6 +142,8 @@ struct lua_State {
   CallInfo *base_ci;  /* array of CallInfo's */
   int stacksize;
   int size_ci;  /* size of array `base_ci' */
+  int minstack;  /* the collector does not shrink `stack' below this... */
+  int minci;  /* ...nor `base_ci' below this */
   unsigned short nCcalls;  /* number of nested C calls */
   unsigned short baseCcalls;  /* nested C calls when resuming coroutine */
   lu_byte hookmask;
@@ -164,6 +197,13 @@ union GCObject {
 
 LUAI_FUNC lua_State *luaE_newthread (lua_State *L);
 LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
+#if defined(LUA_USE_LOCK)
+LUAI_FUNC void luaE_lock (lua_State *L);
+LUAI_FUNC void luaE_unlock (lua_State *L);
+LUAI_FUNC void luaE_yield (lua_State *L);
+#endif
+LUAI_FUNC void luaE_setstackpool (lua_State *L, int n, int stacksize,
+                                  int size_ci);
 
 #endif
 
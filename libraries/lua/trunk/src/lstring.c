@@ -12,6 +12,7 @@
 
 #include "lua.h"
 
+#include "ldo.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -47,10 +48,9 @@ void luaS_resize (lua_State *L, int newsize) {
 }
 
 
-static TString *newlstr (lua_State *L, const char *str, size_t l,
-                                       unsigned int h) {
+static TString *createstr (lua_State *L, const char *str, size_t l,
+                                         unsigned int h) {
   TString *ts;
-  stringtable *tb;
   if (l+1 > (MAX_SIZET - sizeof(TString))/sizeof(char))
     luaM_toobig(L);
   ts = cast(TString *, luaM_malloc(L, (l+1)*sizeof(char)+sizeof(TString)));
@@ -59,9 +59,17 @@ static TString *newlstr (lua_State *L, const char *str, size_t l,
   ts->tsv.marked = luaC_white(G(L));
   ts->tsv.tt = LUA_TSTRING;
   ts->tsv.reserved = 0;
+  ts->tsv.kind = STRHASHED;
   memcpy(ts+1, str, l*sizeof(char));
   ((char *)(ts+1))[l] = '\0';  /* ending 0 */
-  tb = &G(L)->strt;
+  return ts;
+}
+
+
+static TString *newlstr (lua_State *L, const char *str, size_t l,
+                                       unsigned int h) {
+  TString *ts = createstr(L, str, l, h);
+  stringtable *tb = &G(L)->strt;
   h = lmod(h, tb->size);
   ts->tsv.next = tb->hash[h];  /* chain new entry */
   tb->hash[h] = obj2gco(ts);
@@ -72,13 +80,156 @@ static TString *newlstr (lua_State *L, const char *str, size_t l,
 }
 
 
-TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
-  GCObject *o;
-  unsigned int h = cast(unsigned int, l);  /* seed */
+#if defined(LUAI_HASHFULL)
+
+/*
+** hash all characters, a word at a time (`memcpy' of a constant size
+** compiles to a single unaligned load where that is allowed)
+*/
+static unsigned int hashstr (const char *str, size_t l, unsigned int h) {
+  for (; l >= sizeof(lu_int32); l -= sizeof(lu_int32)) {
+    lu_int32 w;
+    memcpy(&w, str, sizeof(w));
+    str += sizeof(w);
+    h = (h ^ w) * 0x9e3779b1u;
+    h ^= h >> 15;
+  }
+  for (; l > 0; l--)
+    h = h ^ ((h<<5)+(h>>2)+cast(unsigned char, *str++));
+  return h ^ (h >> 16);  /* low bits select the chain */
+}
+
+#else
+
+static unsigned int hashstr (const char *str, size_t l, unsigned int h) {
   size_t step = (l>>5)+1;  /* if string is too long, don't hash all its chars */
   size_t l1;
   for (l1=l; l1>=step; l1-=step)  /* compute hash */
     h = h ^ ((h<<5)+(h>>2)+cast(unsigned char, str[l1-1]));
+  return h;
+}
+
+#endif
+
+
+/*
+** Strings longer than LUAI_MAXSHORTLEN are not interned: they go to the
+** list of all objects, as tables do, so that creating them does not
+** need hashing and equal long strings may be different objects. Their
+** hash is computed only when they are used as table keys (until then,
+** `hash' keeps the seed).
+*/
+static TString *newlngstr (lua_State *L, const char *str, size_t l) {
+  TString *ts = createstr(L, str, l, G(L)->seed);
+  ts->tsv.kind = LNGSTR;  /* no hash yet */
+  luaC_link(L, obj2gco(ts), LUA_TSTRING);
+  return ts;
+}
+
+
+/*
+** External strings are long strings whose contents belong to the
+** caller. Short ones are copied, so that all short strings are interned.
+*/
+struct ExtArgs {  /* data to `f_newextstr' */
+  const char *s;
+  size_t l;
+  lua_ExtFree freefn;
+  void *ud;
+  TString *ts;  /* result */
+};
+
+
+static void f_newextstr (lua_State *L, void *ud) {
+  struct ExtArgs *a = cast(struct ExtArgs *, ud);
+  if (a->l <= LUAI_MAXSHORTLEN)
+    a->ts = luaS_newlstr(L, a->s, a->l);
+  else {
+    TString *ts = cast(TString *, luaM_malloc(L, sizeof(TString) +
+                                                 sizeof(ExtString)));
+    ExtString *e = extstr(ts);
+    ts->tsv.len = a->l;
+    ts->tsv.hash = G(L)->seed;
+    ts->tsv.reserved = 0;
+    ts->tsv.kind = LNGSTR | EXTSTR;
+    e->s = a->s;
+    e->freefn = a->freefn;
+    e->ud = a->ud;
+    luaC_link(L, obj2gco(ts), LUA_TSTRING);
+    a->ts = ts;
+  }
+}
+
+
+/*
+** The contents always pass to Lua: `freefn' runs at once if they are
+** not kept (copied, or a memory error), else when the string is freed
+*/
+TString *luaS_newextstr (lua_State *L, const char *s, size_t l,
+                         lua_ExtFree freefn, void *ud) {
+  struct ExtArgs a;
+  int status;
+  a.s = s; a.l = l; a.freefn = freefn; a.ud = ud;
+  status = luaD_rawrunprotected(L, f_newextstr, &a);
+  if (status != 0 || l <= LUAI_MAXSHORTLEN) {  /* contents not kept? */
+    if (freefn) (*freefn)(ud, s, l);
+    if (status != 0) luaD_throw(L, status);
+  }
+  return a.ts;
+}
+
+
+/*
+** Release the contents of all external strings still alive, for a
+** `lua_close' that does not free objects one by one (see `bulkfree')
+*/
+void luaS_freeallext (lua_State *L) {
+  GCObject *o;
+  for (o = G(L)->rootgc; o != NULL; o = o->gch.next) {
+    if (o->gch.tt == LUA_TSTRING && (gco2ts(o)->kind & EXTSTR)) {
+      ExtString *e = extstr(rawgco2ts(o));
+      if (e->freefn) (*e->freefn)(e->ud, e->s, gco2ts(o)->len);
+    }
+  }
+}
+
+
+void luaS_freestr (lua_State *L, TString *ts) {
+  if (!islngstr(ts))
+    G(L)->strt.nuse--;
+  else if (ts->tsv.kind & EXTSTR) {
+    ExtString *e = extstr(ts);
+    if (e->freefn) (*e->freefn)(e->ud, e->s, ts->tsv.len);
+  }
+  luaM_freemem(L, ts, sizestring(&ts->tsv));
+}
+
+
+int luaS_eqlngstr (TString *a, TString *b) {
+  size_t len = a->tsv.len;
+  lua_assert(islngstr(a));
+  return (a == b) ||
+         (len == b->tsv.len && memcmp(getstr(a), getstr(b), len) == 0);
+}
+
+
+unsigned int luaS_hashlong (TString *ts) {
+  lua_assert(islngstr(ts));
+  if (!(ts->tsv.kind & STRHASHED)) {
+    size_t l = ts->tsv.len;
+    ts->tsv.hash = hashstr(getstr(ts), l, ts->tsv.hash ^ cast(unsigned int, l));
+    ts->tsv.kind |= STRHASHED;
+  }
+  return ts->tsv.hash;
+}
+
+
+TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
+  GCObject *o;
+  unsigned int h;
+  if (l > LUAI_MAXSHORTLEN)
+    return newlngstr(L, str, l);
+  h = hashstr(str, l, G(L)->seed ^ cast(unsigned int, l));
   for (o = G(L)->strt.hash[lmod(h, G(L)->strt.size)];
        o != NULL;
        o = o->gch.next) {
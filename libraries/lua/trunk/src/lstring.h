@@ -13,7 +13,8 @@
 #include "lstate.h"
 
 
-#define sizestring(s)	(sizeof(union TString)+((s)->len+1)*sizeof(char))
+#define sizestring(s)	(sizeof(union TString) + (((s)->kind & EXTSTR) ? \
+                         sizeof(ExtString) : ((s)->len+1)*sizeof(char)))
 
 #define sizeudata(u)	(sizeof(union Udata)+(u)->len)
 
@@ -23,9 +24,23 @@
 
 #define luaS_fix(s)	l_setbit((s)->tsv.marked, FIXEDBIT)
 
+#define islngstr(s)	((s)->tsv.kind & LNGSTR)
+
+/* equal short strings are the same object */
+#define luaS_eqstr(a,b)	((a) == (b) || (islngstr(a) && luaS_eqlngstr(a, b)))
+
+#define luaS_hash(s)	(((s)->tsv.kind & STRHASHED) ? (s)->tsv.hash : \
+                                                       luaS_hashlong(s))
+
 LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
 LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s, Table *e);
 LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
+LUAI_FUNC TString *luaS_newextstr (lua_State *L, const char *s, size_t l,
+                                   lua_ExtFree freefn, void *ud);
+LUAI_FUNC void luaS_freestr (lua_State *L, TString *ts);
+LUAI_FUNC void luaS_freeallext (lua_State *L);
+LUAI_FUNC int luaS_eqlngstr (TString *a, TString *b);
+LUAI_FUNC unsigned int luaS_hashlong (TString *ts);
 
 
 #endif
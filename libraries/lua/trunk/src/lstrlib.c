@@ -6,6 +6,9 @@
 
 
 #include <ctype.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,6 +22,10 @@
 #include "lauxlib.h"
 #include "lualib.h"
 
+#if defined(LUAI_SSE2FIND)
+#include <emmintrin.h>
+#endif
+
 
 /* macro to `unsign' a character */
 #define uchar(c)        ((unsigned char)(c))
@@ -96,6 +103,21 @@ static int str_rep (lua_State *L) {
   const char *s = luaL_checklstring(L, 1, &l);
   int n = luaL_checkint(L, 2);
   luaL_buffinit(L, &b);
+#if defined(LUAL_BUFFERGROW)
+  if (n > 0 && l > 0 && l <= ~(size_t)0 / (size_t)n) {  /* no overflow? */
+    size_t total = l * (size_t)n;
+    size_t done = l;
+    char *p = luaL_prepbuffsize(&b, total);  /* room for all at once */
+    memcpy(p, s, l);
+    while (done < total) {  /* double what is already there */
+      size_t c = (done <= total - done) ? done : total - done;
+      memcpy(p + done, p, c);
+      done += c;
+    }
+    luaL_addsize(&b, total);
+    n = 0;
+  }
+#endif
   while (n-- > 0)
     luaL_addlstring(&b, s, l);
   luaL_pushresult(&b);
@@ -167,10 +189,48 @@ static int str_dump (lua_State *L) {
 #define CAP_UNFINISHED	(-1)
 #define CAP_POSITION	(-2)
 
+
+/* kinds of items in a compiled pattern */
+enum {
+  PI_END, PI_EOS, PI_OPEN, PI_POSITION, PI_CLOSE, PI_BALANCE, PI_FRONTIER,
+  PI_BACKREF,
+  /* items that match a single char (and may be repeated) */
+  PI_CHAR, PI_ANY, PI_CLASS, PI_SET, PI_BRACKET
+};
+
+typedef struct PatItem {
+  unsigned char op;  /* kind of item */
+  unsigned char cls;  /* single char kind (for a single char or `%f') */
+  unsigned char rep;  /* 0 or repetition (`?', `*', `+' or `-') */
+  unsigned char c;  /* char; class; capture digit; `%b' open char */
+  int x, y;  /* `%b' close char; set number; `[' and `]' offsets in text */
+} PatItem;
+
+typedef struct CPattern {
+  int anchor;  /* pattern starts with `^' */
+  int start;  /* item that every match starts with (or -1) */
+  int lprefix;  /* length of `prefix' */
+  int set;  /* bitmaps of the sets without classes */
+  int text;  /* pattern source */
+  int prefix;  /* plain chars that every match starts with */
+} CPattern;
+
+/*
+** the parts of a compiled pattern follow it in the same block (items
+** first, ending with PI_END); they are kept as offsets, not pointers, so
+** that a byte copy of the block is still a valid pattern
+*/
+#define cpitem(cp)	((PatItem *)((cp) + 1))
+#define cpset(cp)	((unsigned char (*)[32])((char *)((cp) + 1) + (cp)->set))
+#define cptext(cp)	((char *)((cp) + 1) + (cp)->text)
+#define cpprefix(cp)	((char *)((cp) + 1) + (cp)->prefix)
+
+
 typedef struct MatchState {
   const char *src_init;  /* init of source string */
   const char *src_end;  /* end (`\0') of source string */
   lua_State *L;
+  const CPattern *cp;  /* compiled pattern (NULL to interpret it) */
   int level;  /* total number of captures (finished or unfinished) */
   struct {
     const char *init;
@@ -278,26 +338,29 @@ static int singlematch (int c, const char *p, const char *ep) {
 static const char *match (MatchState *ms, const char *s, const char *p);
 
 
-static const char *matchbalance (MatchState *ms, const char *s,
-                                   const char *p) {
-  if (*p == 0 || *(p+1) == 0)
-    luaL_error(ms->L, "unbalanced pattern");
-  if (*s != *p) return NULL;
+static const char *balance (MatchState *ms, const char *s, int b, int e) {
+  if (uchar(*s) != b) return NULL;
   else {
-    int b = *p;
-    int e = *(p+1);
     int cont = 1;
     while (++s < ms->src_end) {
-      if (*s == e) {
+      if (uchar(*s) == e) {
         if (--cont == 0) return s+1;
       }
-      else if (*s == b) cont++;
+      else if (uchar(*s) == b) cont++;
     }
   }
   return NULL;  /* string ends out of balance */
 }
 
 
+static const char *matchbalance (MatchState *ms, const char *s,
+                                   const char *p) {
+  if (*p == 0 || *(p+1) == 0)
+    luaL_error(ms->L, "unbalanced pattern");
+  return balance(ms, s, uchar(*p), uchar(*(p+1)));
+}
+
+
 static const char *max_expand (MatchState *ms, const char *s,
                                  const char *p, const char *ep) {
   ptrdiff_t i = 0;  /* counts maximum expand for item */
@@ -441,28 +504,499 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
 
 
 
+/*
+** Plain search: candidates must have the first and the last chars of
+** `s2' at the right places (with SSE2, 16 candidates are tested at once)
+** before the other chars are compared
+*/
 static const char *lmemfind (const char *s1, size_t l1,
                                const char *s2, size_t l2) {
   if (l2 == 0) return s1;  /* empty strings are everywhere */
   else if (l2 > l1) return NULL;  /* avoids a negative `l1' */
+  else if (l2 == 1) return (const char *)memchr(s1, *s2, l1);
   else {
     const char *init;  /* to search for a `*s2' inside `s1' */
-    l2--;  /* 1st char will be checked by `memchr' */
-    l1 = l1-l2;  /* `s2' cannot be found after that */
-    while (l1 > 0 && (init = (const char *)memchr(s1, *s2, l1)) != NULL) {
-      init++;   /* 1st char is already checked */
-      if (memcmp(init, s2+1, l2) == 0)
-        return init-1;
-      else {  /* correct `l1' and `s1' to try again */
-        l1 -= init-s1;
-        s1 = init;
+    const char *last = s1 + (l1 - l2);  /* last candidate */
+    int lc = s2[l2-1];
+#if defined(LUAI_SSE2FIND)
+    const __m128i first16 = _mm_set1_epi8(*s2);
+    const __m128i last16 = _mm_set1_epi8((char)lc);
+    for (; last - s1 >= 16; s1 += 16) {  /* 16 candidates (all in `s1') */
+      __m128i f = _mm_loadu_si128((const __m128i *)s1);
+      __m128i l = _mm_loadu_si128((const __m128i *)(s1 + l2 - 1));
+      unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+          _mm_cmpeq_epi8(f, first16), _mm_cmpeq_epi8(l, last16)));
+      while (mask != 0) {
+        init = s1 + __builtin_ctz(mask);
+        if (memcmp(init + 1, s2 + 1, l2 - 2) == 0)
+          return init;
+        mask &= mask - 1;  /* next candidate */
       }
     }
+#endif
+    while (s1 <= last &&
+           (init = (const char *)memchr(s1, *s2, last - s1 + 1)) != NULL) {
+      if (init[l2-1] == lc && memcmp(init + 1, s2 + 1, l2 - 2) == 0)
+        return init;
+      s1 = init + 1;  /* try again after it */
+    }
     return NULL;  /* not found */
   }
 }
 
 
+/*
+** Compiled patterns: `translate' turns a pattern into an array of items
+** that `cmatch' runs just as `match' runs the source, but without
+** scanning classes and sets again at each char
+*/
+
+#if defined(LUAI_PATCOMPILE)
+
+/* `classend' for `translate': returns NULL instead of raising errors */
+static const char *checkclassend (const char *p) {
+  switch (*p++) {
+    case L_ESC: {
+      return (*p == '\0') ? NULL : p+1;
+    }
+    case '[': {
+      if (*p == '^') p++;
+      do {  /* look for a `]' */
+        if (*p == '\0') return NULL;
+        if (*(p++) == L_ESC && *p != '\0')
+          p++;  /* skip escapes (e.g. `%]') */
+      } while (*p != ']');
+      return p+1;
+    }
+    default: {
+      return p;
+    }
+  }
+}
+
+
+/* does `%c' stand for a class (and not for the char `c')? */
+static int isclass (int c) {
+  return (strchr("acdlpsuwxz", tolower(c)) != NULL);
+}
+
+
+/*
+** fills the kind of single char item at `p' (ending at `ep'); sets
+** without classes become bitmaps, which do not depend on the locale
+*/
+static void singleitem (PatItem *it, CPattern *cp, int *nsets,
+                        const char *text, const char *p, const char *ep) {
+  switch (*p) {
+    case '.': {
+      it->cls = PI_ANY;
+      break;
+    }
+    case L_ESC: {
+      it->c = uchar(*(p+1));
+      it->cls = isclass(it->c) ? PI_CLASS : PI_CHAR;
+      break;
+    }
+    case '[': {
+      const char *q;
+      it->cls = PI_SET;
+      for (q = p+1; q < ep-1; q++)
+        if (*q == L_ESC && isclass(uchar(*++q))) it->cls = PI_BRACKET;
+      if (it->cls == PI_BRACKET) {
+        it->x = (int)(p - text);
+        it->y = (int)(ep - 1 - text);
+      }
+      else {
+        if (cp) {
+          unsigned char *bits = cpset(cp)[*nsets];
+          int c;
+          memset(bits, 0, sizeof(cpset(cp)[0]));
+          for (c = 0; c <= UCHAR_MAX; c++)
+            if (matchbracketclass(c, p, ep-1))
+              bits[c >> 3] |= (unsigned char)(1 << (c & 7));
+        }
+        it->x = (*nsets)++;
+      }
+      break;
+    }
+    default: {
+      it->c = uchar(*p);
+      it->cls = PI_CHAR;
+      break;
+    }
+  }
+}
+
+
+/*
+** translates pattern `text' into the items of `cp' (or only counts its
+** items and sets, when `cp' is NULL). Returns 0 for a malformed pattern
+** or one with bad captures, which are left to `match' so that its errors
+** come just as before; so captures in `cmatch' never raise errors.
+*/
+static int translate (CPattern *cp, const char *text, int *nitems,
+                                                       int *nsets) {
+  const char *p = text;
+  int level = 0, open = 0;  /* captures and unfinished captures */
+  *nitems = *nsets = 0;
+  if (*p == '^') p++;
+  for (;;) {
+    PatItem it;
+    it.op = it.cls = it.rep = it.c = 0;
+    it.x = it.y = 0;
+    switch (*p) {
+      case '\0': {
+        it.op = PI_END;
+        break;
+      }
+      case '(': {
+        if (++level > LUA_MAXCAPTURES) return 0;
+        if (*(p+1) == ')') {
+          it.op = PI_POSITION;
+          p += 2;
+        }
+        else {
+          it.op = PI_OPEN;
+          open++;
+          p++;
+        }
+        break;
+      }
+      case ')': {
+        if (open-- == 0) return 0;
+        it.op = PI_CLOSE;
+        p++;
+        break;
+      }
+      case L_ESC: {
+        if (*(p+1) == 'b') {
+          if (*(p+2) == '\0' || *(p+3) == '\0') return 0;
+          it.op = PI_BALANCE;
+          it.c = uchar(*(p+2));
+          it.x = uchar(*(p+3));
+          p += 4;
+          break;
+        }
+        else if (*(p+1) == 'f') {
+          const char *ep;
+          p += 2;
+          if (*p != '[' || (ep = checkclassend(p)) == NULL) return 0;
+          it.op = PI_FRONTIER;
+          singleitem(&it, cp, nsets, text, p, ep);
+          p = ep;
+          break;
+        }
+        else if (isdigit(uchar(*(p+1)))) {
+          it.op = PI_BACKREF;
+          it.c = uchar(*(p+1));
+          p += 2;
+          break;
+        }
+        goto dflt;
+      }
+      case '$': {
+        if (*(p+1) == '\0') {
+          it.op = PI_EOS;
+          p++;
+          break;
+        }
+        goto dflt;
+      }
+      default: dflt: {
+        const char *ep = checkclassend(p);
+        if (ep == NULL) return 0;
+        singleitem(&it, cp, nsets, text, p, ep);
+        it.op = it.cls;
+        if (*ep == '?' || *ep == '*' || *ep == '+' || *ep == '-')
+          it.rep = uchar(*ep++);
+        p = ep;
+        break;
+      }
+    }
+    if (cp) cpitem(cp)[*nitems] = it;
+    (*nitems)++;
+    if (it.op == PI_END) return 1;
+  }
+}
+
+
+/*
+** the single char item that must match at the position where `pi' is
+** tried, past any captures (which match the empty string), or NULL
+*/
+static const PatItem *firstchar (const PatItem *pi) {
+  while (pi->op == PI_OPEN || pi->op == PI_POSITION || pi->op == PI_CLOSE)
+    pi++;
+  return (pi->op >= PI_CHAR && (pi->rep == 0 || pi->rep == '+')) ? pi : NULL;
+}
+
+
+/* plain chars matched by the items from `pi' (captures aside) */
+static int literalprefix (const PatItem *pi, char *prefix) {
+  int n = 0;
+  for (; pi->op != PI_END; pi++) {
+    if (pi->op == PI_OPEN || pi->op == PI_POSITION || pi->op == PI_CLOSE)
+      continue;  /* matches the empty string */
+    if (pi->op != PI_CHAR || (pi->rep != 0 && pi->rep != '+'))
+      break;
+    prefix[n++] = (char)pi->c;
+    if (pi->rep == '+') break;  /* next one may be this char again */
+  }
+  return n;
+}
+
+
+/* pushes the compiled form of pattern `text' (nil if it is malformed) */
+static const CPattern *compile (lua_State *L, const char *text) {
+  size_t l = strlen(text) + 1;
+  int nitems, nsets;
+  CPattern *cp;
+  if (!translate(NULL, text, &nitems, &nsets)) {
+    lua_pushnil(L);
+    return NULL;
+  }
+  cp = (CPattern *)lua_newuserdata(L, sizeof(CPattern) + nitems *
+          sizeof(PatItem) + nsets * sizeof(cpset(cp)[0]) + l + nitems);
+  cp->set = nitems * (int)sizeof(PatItem);
+  cp->text = cp->set + nsets * (int)sizeof(cpset(cp)[0]);
+  cp->prefix = cp->text + (int)l;
+  memcpy(cptext(cp), text, l);
+  translate(cp, cptext(cp), &nitems, &nsets);
+  cp->lprefix = literalprefix(cpitem(cp), cpprefix(cp));
+  cp->anchor = (*text == '^');
+  cp->start = firstchar(cpitem(cp)) ?
+              (int)(firstchar(cpitem(cp)) - cpitem(cp)) : -1;
+  return cp;
+}
+
+
+/*
+** pushes the compiled form of the pattern at `idx' (or nil, when it must
+** be interpreted); compiled patterns are cached in the (weak) environment
+*/
+static const CPattern *getpattern (lua_State *L, int idx) {
+  const CPattern *cp;
+  lua_pushvalue(L, idx);
+  lua_rawget(L, LUA_ENVIRONINDEX);
+  cp = (const CPattern *)lua_touserdata(L, -1);
+  if (cp == NULL) {
+    lua_pop(L, 1);
+    cp = compile(L, lua_tostring(L, idx));
+    if (cp != NULL) {
+      lua_pushvalue(L, idx);
+      lua_pushvalue(L, -2);
+      lua_rawset(L, LUA_ENVIRONINDEX);
+    }
+  }
+  return cp;
+}
+
+
+static int csingle (MatchState *ms, const PatItem *pi, int c) {
+  switch (pi->cls) {
+    case PI_CHAR: return (pi->c == c);
+    case PI_ANY: return 1;
+    case PI_CLASS: return match_class(c, pi->c);
+    case PI_SET: return (cpset(ms->cp)[pi->x][c >> 3] >> (c & 7)) & 1;
+    default: return matchbracketclass(c, cptext(ms->cp) + pi->x,
+                                         cptext(ms->cp) + pi->y);
+  }
+}
+
+
+static const char *cmatch (MatchState *ms, const char *s,
+                           const PatItem *pi);
+
+
+static const char *cmax_expand (MatchState *ms, const char *s,
+                                  const PatItem *pi) {
+  const PatItem *next = pi + 1;
+  ptrdiff_t n = ms->src_end - s;
+  ptrdiff_t i = 0;  /* counts maximum expand for item */
+  switch (pi->cls) {
+    case PI_ANY: {
+      i = n;
+      break;
+    }
+    case PI_CHAR: {
+      while (i < n && uchar(s[i]) == pi->c) i++;
+      break;
+    }
+    case PI_SET: {
+      const unsigned char *set = cpset(ms->cp)[pi->x];
+      while (i < n && (set[uchar(s[i]) >> 3] >> (uchar(s[i]) & 7)) & 1) i++;
+      break;
+    }
+    default: {
+      while (i < n && csingle(ms, pi, uchar(s[i]))) i++;
+      break;
+    }
+  }
+  if (next->op == PI_END)
+    return s+i;
+  else {
+    /* skip the repetitions not followed by a char that must come next */
+    const PatItem *nc = firstchar(next);
+    /* (which cannot be any of the repeated ones if the item rejects it) */
+    ptrdiff_t min = (nc && nc->cls == PI_CHAR && !csingle(ms, pi, nc->c)) ?
+                    i : 0;
+    /* keeps trying to match with the maximum repetitions */
+    for (; i >= min; i--) {
+      if (nc == NULL || (i < n && csingle(ms, nc, uchar(s[i])))) {
+        const char *res = cmatch(ms, s+i, next);
+        if (res) return res;
+      }
+    }
+    return NULL;
+  }
+}
+
+
+static const char *cmin_expand (MatchState *ms, const char *s,
+                                  const PatItem *pi) {
+  for (;;) {
+    const char *res = cmatch(ms, s, pi+1);
+    if (res != NULL)
+      return res;
+    else if (s<ms->src_end && csingle(ms, pi, uchar(*s)))
+      s++;  /* try with one more repetition */
+    else return NULL;
+  }
+}
+
+
+static const char *cstart_capture (MatchState *ms, const char *s,
+                                     const PatItem *pi, int what) {
+  const char *res;
+  int level = ms->level;
+  if (level >= LUA_MAXCAPTURES) luaL_error(ms->L, "too many captures");
+  ms->capture[level].init = s;
+  ms->capture[level].len = what;
+  ms->level = level+1;
+  if ((res=cmatch(ms, s, pi)) == NULL)  /* match failed? */
+    ms->level--;  /* undo capture */
+  return res;
+}
+
+
+static const char *cend_capture (MatchState *ms, const char *s,
+                                   const PatItem *pi) {
+  int l = capture_to_close(ms);
+  const char *res;
+  ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
+  if ((res = cmatch(ms, s, pi)) == NULL)  /* match failed? */
+    ms->capture[l].len = CAP_UNFINISHED;  /* undo capture */
+  return res;
+}
+
+
+/* `match' over the items of a compiled pattern */
+static const char *cmatch (MatchState *ms, const char *s,
+                           const PatItem *pi) {
+  init: /* using goto's to optimize tail recursion */
+  switch (pi->op) {
+    case PI_END: {  /* end of pattern */
+      return s;  /* match succeeded */
+    }
+    case PI_EOS: {  /* check end of string */
+      return (s == ms->src_end) ? s : NULL;
+    }
+    case PI_OPEN: {
+      return cstart_capture(ms, s, pi+1, CAP_UNFINISHED);
+    }
+    case PI_POSITION: {
+      return cstart_capture(ms, s, pi+1, CAP_POSITION);
+    }
+    case PI_CLOSE: {
+      return cend_capture(ms, s, pi+1);
+    }
+    case PI_BALANCE: {
+      s = balance(ms, s, pi->c, pi->x);
+      if (s == NULL) return NULL;
+      pi++; goto init;
+    }
+    case PI_FRONTIER: {
+      int previous = (s == ms->src_init) ? '\0' : uchar(*(s-1));
+      if (csingle(ms, pi, previous) || !csingle(ms, pi, uchar(*s)))
+        return NULL;
+      pi++; goto init;
+    }
+    case PI_BACKREF: {
+      s = match_capture(ms, s, pi->c);
+      if (s == NULL) return NULL;
+      pi++; goto init;
+    }
+    default: {  /* a single char item */
+      int m = s<ms->src_end && csingle(ms, pi, uchar(*s));
+      switch (pi->rep) {
+        case '?': {  /* optional */
+          const char *res;
+          if (m && ((res=cmatch(ms, s+1, pi+1)) != NULL))
+            return res;
+          pi++; goto init;
+        }
+        case '*': {  /* 0 or more repetitions */
+          return cmax_expand(ms, s, pi);
+        }
+        case '+': {  /* 1 or more repetitions */
+          return (m ? cmax_expand(ms, s+1, pi) : NULL);
+        }
+        case '-': {  /* 0 or more repetitions (minimum) */
+          return cmin_expand(ms, s, pi);
+        }
+        default: {
+          if (!m) return NULL;
+          s++; pi++; goto init;
+        }
+      }
+    }
+  }
+}
+
+
+/*
+** first position from `s' where a match may start (or NULL if there is
+** none): where the literal prefix of the pattern is, or else where the
+** item that starts every match matches
+*/
+static const char *nextstart (MatchState *ms, const char *s) {
+  const PatItem *pi;
+  if (ms->cp == NULL || ms->cp->start < 0)
+    return s;
+  else if (ms->cp->lprefix > 0)
+    return lmemfind(s, ms->src_end - s, cpprefix(ms->cp), ms->cp->lprefix);
+  pi = cpitem(ms->cp) + ms->cp->start;
+  while (s < ms->src_end && !csingle(ms, pi, uchar(*s))) s++;
+  return (s < ms->src_end) ? s : NULL;
+}
+
+
+#define domatch(ms,s,p) \
+	((ms)->cp ? cmatch(ms, s, cpitem((ms)->cp)) : match(ms, s, p))
+
+
+/*
+** `cp' for the functions where a leading `^' is a plain char (and not an
+** anchor): an anchored pattern has to be interpreted there
+*/
+static const CPattern *unanchored (const CPattern *cp) {
+  return (cp && cp->anchor) ? NULL : cp;
+}
+
+#else
+
+#define getpattern(L,idx)	(lua_pushnil(L), (const CPattern *)NULL)
+#define nextstart(ms,s)	(s)
+#define domatch(ms,s,p)	match(ms, s, p)
+#define unanchored(cp)	(cp)
+
+#endif
+
+
+
+
+
+
 static void push_onecapture (MatchState *ms, int i, const char *s,
                                                     const char *e) {
   if (i >= ms->level) {
@@ -514,12 +1048,15 @@ static int str_find_aux (lua_State *L, int find) {
     int anchor = (*p == '^') ? (p++, 1) : 0;
     const char *s1=s+init;
     ms.L = L;
+    ms.cp = getpattern(L, 2);
     ms.src_init = s;
     ms.src_end = s+l1;
     do {
       const char *res;
+      if (!anchor && (s1 = nextstart(&ms, s1)) == NULL)
+        break;
       ms.level = 0;
-      if ((res=match(&ms, s1, p)) != NULL) {
+      if ((res=domatch(&ms, s1, p)) != NULL) {
         if (find) {
           lua_pushinteger(L, s1-s+1);  /* start */
           lua_pushinteger(L, res-s);   /* end */
@@ -552,14 +1089,18 @@ static int gmatch_aux (lua_State *L) {
   const char *p = lua_tostring(L, lua_upvalueindex(2));
   const char *src;
   ms.L = L;
+  ms.cp = unanchored((const CPattern *)lua_touserdata(L,
+                                           lua_upvalueindex(4)));
   ms.src_init = s;
   ms.src_end = s+ls;
   for (src = s + (size_t)lua_tointeger(L, lua_upvalueindex(3));
        src <= ms.src_end;
        src++) {
     const char *e;
+    if ((src = nextstart(&ms, src)) == NULL)
+      break;
     ms.level = 0;
-    if ((e = match(&ms, src, p)) != NULL) {
+    if ((e = domatch(&ms, src, p)) != NULL) {
       lua_Integer newstart = e-s;
       if (e == src) newstart++;  /* empty match? go at least one position */
       lua_pushinteger(L, newstart);
@@ -576,7 +1117,8 @@ static int gmatch (lua_State *L) {
   luaL_checkstring(L, 2);
   lua_settop(L, 2);
   lua_pushinteger(L, 0);
-  lua_pushcclosure(L, gmatch_aux, 3);
+  (void)getpattern(L, 2);  /* compiled pattern (or nil) */
+  lua_pushcclosure(L, gmatch_aux, 4);
   return 1;
 }
 
@@ -654,14 +1196,21 @@ static int str_gsub (lua_State *L) {
   luaL_argcheck(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3,
                       "string/function/table expected");
-  luaL_buffinit(L, &b);
   ms.L = L;
+  ms.cp = getpattern(L, 2);  /* (before the buffer, which uses the stack) */
   ms.src_init = src;
   ms.src_end = src+srcl;
+  luaL_buffinit(L, &b);
   while (n < max_s) {
     const char *e;
+    if (!anchor) {
+      const char *s1 = nextstart(&ms, src);
+      if (s1 == NULL) break;
+      luaL_addlstring(&b, src, s1 - src);  /* copy chars that cannot match */
+      src = s1;
+    }
     ms.level = 0;
-    e = match(&ms, src, p);
+    e = domatch(&ms, src, p);
     if (e) {
       n++;
       add_value(&ms, &b, src, e);
@@ -679,6 +1228,100 @@ static int str_gsub (lua_State *L) {
   return 2;
 }
 
+
+/*
+** finds the first separator from `s' (empty matches do not count);
+** returns its start (NULL if there is none) and its end in `*e'
+*/
+static const char *findsep (MatchState *ms, const char *s, const char *sep,
+                            size_t lsep, int plain, const char **e) {
+  if (plain) {
+    s = (lsep == 0) ? NULL : lmemfind(s, ms->src_end - s, sep, lsep);
+    if (s) *e = s + lsep;
+    return s;
+  }
+  for (; s < ms->src_end; s++) {
+    if ((s = nextstart(ms, s)) == NULL)
+      break;
+    ms->level = 0;
+    if ((*e = domatch(ms, s, sep)) != NULL && *e > s)
+      return s;
+  }
+  return NULL;
+}
+
+
+static int str_split (lua_State *L) {
+  size_t ls, lsep;
+  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *sep = luaL_checklstring(L, 2, &lsep);
+  int plain = lua_toboolean(L, 3) || strpbrk(sep, SPECIALS) == NULL;
+  int max = luaL_optint(L, 4, INT_MAX);
+  int n = 0;
+  const char *s1, *e;
+  MatchState ms;
+  luaL_argcheck(L, max > 0, 4, "out of range");
+  ms.L = L;
+  ms.cp = plain ? NULL : unanchored(getpattern(L, 2));
+  ms.src_init = s;
+  ms.src_end = s+ls;
+  if (plain) {  /* count the fields first, to create the table at size */
+    int nf = 1;
+    for (s1 = s; nf < max && (s1 = findsep(&ms, s1, sep, lsep, 1, &e)); s1 = e)
+      nf++;
+    lua_createtable(L, nf, 0);
+  }
+  else lua_newtable(L);
+  while (++n < max && (s1 = findsep(&ms, s, sep, lsep, plain, &e)) != NULL) {
+    lua_pushlstring(L, s, s1 - s);
+    lua_rawseti(L, -2, n);
+    s = e;  /* next field starts after the separator */
+  }
+  lua_pushlstring(L, s, ms.src_end - s);  /* last field */
+  lua_rawseti(L, -2, n);
+  return 1;
+}
+
+
+static int fields_aux (lua_State *L) {
+  MatchState ms;
+  size_t ls, lsep;
+  const char *s = lua_tolstring(L, lua_upvalueindex(1), &ls);
+  const char *sep = lua_tolstring(L, lua_upvalueindex(2), &lsep);
+  lua_Integer start = lua_tointeger(L, lua_upvalueindex(4));
+  const char *s1, *e;
+  if (start < 0) return 0;  /* last field was already given */
+  ms.L = L;
+  ms.cp = unanchored((const CPattern *)lua_touserdata(L,
+                                           lua_upvalueindex(5)));
+  ms.src_init = s;
+  ms.src_end = s+ls;
+  s1 = findsep(&ms, s + (size_t)start, sep, lsep,
+               lua_toboolean(L, lua_upvalueindex(3)), &e);
+  lua_pushinteger(L, s1 ? e - s : -1);  /* start of next field */
+  lua_replace(L, lua_upvalueindex(4));
+  lua_pushinteger(L, start + 1);
+  lua_pushinteger(L, (s1 ? s1 : ms.src_end) - s);
+  return 2;  /* positions of the field (end is start - 1 if empty) */
+}
+
+
+static int str_fields (lua_State *L) {
+  const char *sep;
+  luaL_checkstring(L, 1);
+  sep = luaL_checkstring(L, 2);
+  lua_settop(L, 3);
+  lua_pushboolean(L, lua_toboolean(L, 3) || strpbrk(sep, SPECIALS) == NULL);
+  lua_replace(L, 3);
+  lua_pushinteger(L, 0);
+  if (lua_toboolean(L, 3))
+    lua_pushnil(L);
+  else
+    (void)getpattern(L, 2);  /* compiled pattern (or nil) */
+  lua_pushcclosure(L, fields_aux, 5);
+  return 1;
+}
+
 /* }====================================================== */
 
 
@@ -722,11 +1365,14 @@ static void addquoted (lua_State *L, luaL_Buffer *b, int arg) {
   luaL_addchar(b, '"');
 }
 
+/* with no `L', returns NULL for an invalid format instead of an error */
 static const char *scanformat (lua_State *L, const char *strfrmt, char *form) {
   const char *p = strfrmt;
   while (*p != '\0' && strchr(FLAGS, *p) != NULL) p++;  /* skip flags */
-  if ((size_t)(p - strfrmt) >= sizeof(FLAGS))
+  if ((size_t)(p - strfrmt) >= sizeof(FLAGS)) {
+    if (L == NULL) return NULL;
     luaL_error(L, "invalid format (repeated flags)");
+  }
   if (isdigit(uchar(*p))) p++;  /* skip width */
   if (isdigit(uchar(*p))) p++;  /* (2 digits at most) */
   if (*p == '.') {
@@ -734,8 +1380,10 @@ static const char *scanformat (lua_State *L, const char *strfrmt, char *form) {
     if (isdigit(uchar(*p))) p++;  /* skip precision */
     if (isdigit(uchar(*p))) p++;  /* (2 digits at most) */
   }
-  if (isdigit(uchar(*p)))
+  if (isdigit(uchar(*p))) {
+    if (L == NULL) return NULL;
     luaL_error(L, "invalid format (width or precision too long)");
+  }
   *(form++) = '%';
   strncpy(form, strfrmt, p - strfrmt + 1);
   form += p - strfrmt + 1;
@@ -753,6 +1401,262 @@ static void addintlen (char *form) {
 }
 
 
+/* adds argument `arg' formatted by `form' (for conversion `conv') */
+static void addformat (lua_State *L, luaL_Buffer *b, int arg, int conv,
+                       const char *form) {
+  char f[MAX_FORMAT];  /* to add the length modifier to `form' */
+  char buff[MAX_ITEM];  /* to store the formatted item */
+  switch (conv) {
+    case 'c': {
+      sprintf(buff, form, (int)luaL_checknumber(L, arg));
+      break;
+    }
+    case 'd':  case 'i': {
+      strcpy(f, form);
+      addintlen(f);
+      sprintf(buff, f, (LUA_INTFRM_T)luaL_checknumber(L, arg));
+      break;
+    }
+    case 'o':  case 'u':  case 'x':  case 'X': {
+      strcpy(f, form);
+      addintlen(f);
+      sprintf(buff, f, (unsigned LUA_INTFRM_T)luaL_checknumber(L, arg));
+      break;
+    }
+    case 'e':  case 'E': case 'f':
+    case 'g': case 'G': {
+      sprintf(buff, form, (double)luaL_checknumber(L, arg));
+      break;
+    }
+    case 'q': {
+      addquoted(L, b, arg);
+      return;  /* skip the 'addsize' at the end */
+    }
+    case 's': {
+      size_t l;
+      const char *s = luaL_checklstring(L, arg, &l);
+      if (!strchr(form, '.') && l >= 100) {
+        /* no precision and string is too long to be formatted;
+           keep original string */
+        lua_pushvalue(L, arg);
+        luaL_addvalue(b);
+        return;  /* skip the `addsize' at the end */
+      }
+      else {
+        sprintf(buff, form, s);
+        break;
+      }
+    }
+    default: {  /* also treat cases `pnLlh' */
+      luaL_error(L, "invalid option " LUA_QL("%%%c") " to "
+                    LUA_QL("format"), conv);
+      return;
+    }
+  }
+  luaL_addlstring(b, buff, strlen(buff));
+}
+
+
+#if defined(LUAI_FMTCOMPILE)
+
+/* a parsed format: literal text and then (maybe) a conversion */
+typedef struct FormatItem {
+  size_t init, len;  /* literal text (in the format string) */
+  char conv;  /* conversion, or 0 when there is none */
+  char simple;  /* conversion without flags, width or precision */
+  signed char prec;  /* N of a `%.Nf' (6 for `%f'), up to 9; else -1 */
+  char form[MAX_FORMAT];  /* the format for `sprintf' */
+} FormatItem;
+
+typedef struct CFormat {
+  int n;  /* number of items */
+  FormatItem item[1];
+} CFormat;
+
+
+/*
+** parses format `strfrmt' into `cf' (or only counts its items, when `cf'
+** is NULL). Returns 0 for an invalid format, which is left to the loop in
+** `str_format' so that its errors come in the same order as before.
+*/
+static int parseformat (CFormat *cf, const char *strfrmt, size_t sfl) {
+  const char *init = strfrmt;
+  const char *strfrmt_end = strfrmt+sfl;
+  const char *lit = strfrmt;  /* start of literal text */
+  int n = 0;
+  while (strfrmt < strfrmt_end) {
+    FormatItem *it = cf ? &cf->item[n] : NULL;
+    if (*strfrmt != L_ESC) {
+      strfrmt++;
+      continue;
+    }
+    else if (*++strfrmt == L_ESC) {  /* %% */
+      if (it) {  /* literal text up to the first `%' */
+        it->init = lit - init;
+        it->len = strfrmt - lit;
+        it->conv = 0;
+      }
+      lit = ++strfrmt;
+    }
+    else {  /* format item */
+      const char *p = strfrmt;
+      char form[MAX_FORMAT];
+      if ((strfrmt = scanformat(NULL, strfrmt, form)) == NULL ||
+          *strfrmt == '\0' || strchr("cdiouxXeEfgGqs", *strfrmt) == NULL)
+        return 0;
+      if (it) {
+        it->init = lit - init;
+        it->len = (p - 1) - lit;
+        it->conv = *strfrmt;
+        strcpy(it->form, form);
+        it->simple = (strfrmt == p);
+        it->prec = -1;
+        if (*strfrmt == 'f') {
+          if (it->simple)
+            it->prec = 6;
+          else if (*p == '.' &&
+                   (strfrmt - p == 2 || (strfrmt - p == 3 && p[1] == '0')))
+            it->prec = (signed char)(*(strfrmt - 1) - '0');  /* `%.Nf' */
+        }
+      }
+      lit = ++strfrmt;
+    }
+    n++;
+  }
+  if (cf) {  /* last literal text */
+    cf->item[n].init = lit - init;
+    cf->item[n].len = strfrmt_end - lit;
+    cf->item[n].conv = 0;
+  }
+  return n + 1;
+}
+
+
+/*
+** pushes the parsed form of the format at `idx' (or nil, when it must be
+** interpreted); parsed formats are cached in the (weak) upvalue
+*/
+static const CFormat *getformat (lua_State *L, int idx) {
+  size_t sfl;
+  const char *strfrmt = lua_tolstring(L, idx, &sfl);
+  CFormat *cf;
+  int n;
+  lua_pushvalue(L, idx);
+  lua_rawget(L, lua_upvalueindex(1));
+  cf = (CFormat *)lua_touserdata(L, -1);
+  if (cf != NULL) return cf;
+  lua_pop(L, 1);
+  if ((n = parseformat(NULL, strfrmt, sfl)) == 0) {
+    lua_pushnil(L);
+    return NULL;
+  }
+  cf = (CFormat *)lua_newuserdata(L, sizeof(CFormat) +
+                                     (n - 1) * sizeof(FormatItem));
+  cf->n = parseformat(cf, strfrmt, sfl);
+  lua_pushvalue(L, idx);
+  lua_pushvalue(L, -2);
+  lua_rawset(L, lua_upvalueindex(1));
+  return cf;
+}
+
+
+/* adds the digits of `u', in base 10 or 16 */
+static void adddigits (luaL_Buffer *b, unsigned LUA_INTFRM_T u, int neg,
+                       int base, const char *digits) {
+  char buff[3 * sizeof(u) + 2];
+  char *s = buff + sizeof(buff);
+  do {
+    *--s = digits[u % base];
+    u /= base;
+  } while (u != 0);
+  if (neg) *--s = '-';
+  luaL_addlstring(b, s, buff + sizeof(buff) - s);
+}
+
+
+/*
+** adds `x' formatted by `%.Nf' (`prec' = N); returns 0, adding nothing,
+** when it cannot do so exactly as `sprintf': the decimal places of `x'
+** times 10^N are computed with an error much smaller than 1e-5, so
+** the rounding is the same as with exact arithmetic unless they are
+** near a half
+*/
+static int addfixed (luaL_Buffer *b, double x, int prec) {
+  static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+                                  1e8, 1e9};
+  const char *dp = localeconv()->decimal_point;
+  char buff[32];
+  char *s = buff + sizeof(buff);
+  int neg = (x < 0 || (x == 0 && 1/x < 0));  /* (`-0.00' for -0.0) */
+  double y = (neg ? -x : x) * powers[prec];
+  double r;
+  unsigned long u;
+  if (!(y < 2147483648.0) || dp[0] == '\0' || dp[1] != '\0')
+    return 0;  /* too large, NaN or odd locale */
+  r = floor(y);
+  if (fabs(y - r - 0.5) < 1e-5)
+    return 0;  /* too near a half to round it */
+  u = (unsigned long)r + (y - r > 0.5);
+  for (; prec > 0; prec--) {  /* decimal places */
+    *--s = (char)('0' + u % 10);
+    u /= 10;
+  }
+  if (s != buff + sizeof(buff)) *--s = dp[0];
+  do {
+    *--s = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (neg) *--s = '-';
+  luaL_addlstring(b, s, buff + sizeof(buff) - s);
+  return 1;
+}
+
+
+/* adds argument `arg' as item `it' without `sprintf', if it can */
+static int addfast (lua_State *L, luaL_Buffer *b, int arg,
+                    const FormatItem *it) {
+  if (it->prec >= 0)
+    return addfixed(b, (double)luaL_checknumber(L, arg), it->prec);
+  else if (it->simple) {
+    switch (it->conv) {
+      case 'd': case 'i': {
+        LUA_INTFRM_T n = (LUA_INTFRM_T)luaL_checknumber(L, arg);
+        adddigits(b, (n < 0) ? 0u - (unsigned LUA_INTFRM_T)n :
+                               (unsigned LUA_INTFRM_T)n,
+                  n < 0, 10, "0123456789");
+        return 1;
+      }
+      case 'x': case 'X': {
+        adddigits(b, (unsigned LUA_INTFRM_T)luaL_checknumber(L, arg), 0, 16,
+                  (it->conv == 'x') ? "0123456789abcdef" : "0123456789ABCDEF");
+        return 1;
+      }
+      case 's': {
+        size_t l;
+        const char *s = luaL_checklstring(L, arg, &l);
+        if (l < 100) l = strlen(s);  /* (`sprintf' stops at a `\0') */
+        luaL_addlstring(b, s, l);
+        return 1;
+      }
+      case 'g': {  /* integers up to 6 digits come as with `%d' */
+        double x = (double)luaL_checknumber(L, arg);
+        if (x > -1e6 && x < 1e6 && x == (double)(long)x &&
+            (x != 0 || 1/x > 0)) {
+          long n = (long)x;
+          adddigits(b, (unsigned LUA_INTFRM_T)((n < 0) ? -n : n), n < 0, 10,
+                    "0123456789");
+          return 1;
+        }
+        return 0;
+      }
+    }
+  }
+  return 0;
+}
+
+#endif
+
+
 static int str_format (lua_State *L) {
   int top = lua_gettop(L);
   int arg = 1;
@@ -760,6 +1664,25 @@ static int str_format (lua_State *L) {
   const char *strfrmt = luaL_checklstring(L, arg, &sfl);
   const char *strfrmt_end = strfrmt+sfl;
   luaL_Buffer b;
+#if defined(LUAI_FMTCOMPILE)
+  const CFormat *cf = getformat(L, 1);  /* (before the buffer) */
+  if (cf != NULL) {
+    int i;
+    luaL_buffinit(L, &b);
+    for (i = 0; i < cf->n; i++) {
+      const FormatItem *it = &cf->item[i];
+      luaL_addlstring(&b, strfrmt + it->init, it->len);
+      if (it->conv) {
+        if (++arg > top)
+          luaL_argerror(L, arg, "no value");
+        if (!addfast(L, &b, arg, it))
+          addformat(L, &b, arg, it->conv, it->form);
+      }
+    }
+    luaL_pushresult(&b);
+    return 1;
+  }
+#endif
   luaL_buffinit(L, &b);
   while (strfrmt < strfrmt_end) {
     if (*strfrmt != L_ESC)
@@ -768,55 +1691,10 @@ static int str_format (lua_State *L) {
       luaL_addchar(&b, *strfrmt++);  /* %% */
     else { /* format item */
       char form[MAX_FORMAT];  /* to store the format (`%...') */
-      char buff[MAX_ITEM];  /* to store the formatted item */
       if (++arg > top)
         luaL_argerror(L, arg, "no value");
       strfrmt = scanformat(L, strfrmt, form);
-      switch (*strfrmt++) {
-        case 'c': {
-          sprintf(buff, form, (int)luaL_checknumber(L, arg));
-          break;
-        }
-        case 'd':  case 'i': {
-          addintlen(form);
-          sprintf(buff, form, (LUA_INTFRM_T)luaL_checknumber(L, arg));
-          break;
-        }
-        case 'o':  case 'u':  case 'x':  case 'X': {
-          addintlen(form);
-          sprintf(buff, form, (unsigned LUA_INTFRM_T)luaL_checknumber(L, arg));
-          break;
-        }
-        case 'e':  case 'E': case 'f':
-        case 'g': case 'G': {
-          sprintf(buff, form, (double)luaL_checknumber(L, arg));
-          break;
-        }
-        case 'q': {
-          addquoted(L, &b, arg);
-          continue;  /* skip the 'addsize' at the end */
-        }
-        case 's': {
-          size_t l;
-          const char *s = luaL_checklstring(L, arg, &l);
-          if (!strchr(form, '.') && l >= 100) {
-            /* no precision and string is too long to be formatted;
-               keep original string */
-            lua_pushvalue(L, arg);
-            luaL_addvalue(&b);
-            continue;  /* skip the `addsize' at the end */
-          }
-          else {
-            sprintf(buff, form, s);
-            break;
-          }
-        }
-        default: {  /* also treat cases `pnLlh' */
-          return luaL_error(L, "invalid option " LUA_QL("%%%c") " to "
-                               LUA_QL("format"), *(strfrmt - 1));
-        }
-      }
-      luaL_addlstring(&b, buff, strlen(buff));
+      addformat(L, &b, arg, *strfrmt++, form);
     }
   }
   luaL_pushresult(&b);
@@ -828,6 +1706,7 @@ static const luaL_Reg strlib[] = {
   {"byte", str_byte},
   {"char", str_char},
   {"dump", str_dump},
+  {"fields", str_fields},
   {"find", str_find},
   {"format", str_format},
   {"gfind", gfind_nodef},
@@ -838,6 +1717,7 @@ static const luaL_Reg strlib[] = {
   {"match", str_match},
   {"rep", str_rep},
   {"reverse", str_reverse},
+  {"split", str_split},
   {"sub", str_sub},
   {"upper", str_upper},
   {NULL, NULL}
@@ -856,11 +1736,29 @@ static void createmetatable (lua_State *L) {
 }
 
 
+/* creates a table with weak values, for compiled patterns or formats */
+static void newcache (lua_State *L) {
+  lua_newtable(L);
+  lua_createtable(L, 0, 1);
+  lua_pushliteral(L, "v");
+  lua_setfield(L, -2, "__mode");
+  lua_setmetatable(L, -2);
+}
+
+
 /*
 ** Open string library
 */
 LUALIB_API int luaopen_string (lua_State *L) {
+  /* create (private) environment: the cache of compiled patterns */
+  newcache(L);
+  lua_replace(L, LUA_ENVIRONINDEX);
   luaL_register(L, LUA_STRLIBNAME, strlib);
+#if defined(LUAI_FMTCOMPILE)
+  newcache(L);  /* cache of parsed formats */
+  lua_pushcclosure(L, str_format, 1);
+  lua_setfield(L, -2, "format");
+#endif
 #if defined(LUA_COMPAT_GFIND)
   lua_getfield(L, -1, "gmatch");
   lua_setfield(L, -2, "gfind");
@@ -16,6 +16,8 @@
 ** in its main position (i.e. the `original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+** With LUAI_OPENHASH, the hash part uses linear probing instead (see
+** below).
 */
 
 #include <math.h>
@@ -32,6 +34,7 @@
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
+#include "lstring.h"
 #include "ltable.h"
 
 
@@ -47,9 +50,18 @@
 #define MAXASIZE	(1 << MAXBITS)
 
 
+/*
+** number of ints inside a lua_Number
+*/
+#define numints		cast_int(sizeof(lua_Number)/sizeof(int))
+
+
+
+#if !defined(LUAI_OPENHASH)
+
 #define hashpow2(t,n)      (gnode(t, lmod((n), sizenode(t))))
   
-#define hashstr(t,str)  hashpow2(t, (str)->tsv.hash)
+#define hashstr(t,str)  hashpow2(t, luaS_hash(str))
 #define hashboolean(t,p)        hashpow2(t, p)
 
 
@@ -63,13 +75,6 @@
 #define hashpointer(t,p)	hashmod(t, IntPoint(p))
 
 
-/*
-** number of ints inside a lua_Number
-*/
-#define numints		cast_int(sizeof(lua_Number)/sizeof(int))
-
-
-
 #define dummynode		(&dummynode_)
 
 static const Node dummynode_ = {
@@ -113,11 +118,113 @@ static Node *mainposition (const Table *t, const TValue *key) {
 }
 
 
+#else
+
+/*
+** Open addressing: a key goes in the first free node after (or at) its
+** main position, so a search reads consecutive nodes until it finds the
+** key or a free node (a node with a nil key). There are no `next'
+** pointers, so nodes are smaller. Tables are kept at most 3/4 full
+** (`nfree' counts how many new keys still fit), so a search always ends.
+** Keys are never removed (as in the chained version, a key with a nil
+** value stays until the next rehash or until a new key reuses its node),
+** so traversals stay valid.
+*/
+
+#define hashpow2(t,n)	lmod((n), sizenode(t))
+
+/*
+** similar keys have similar hashes, which make long runs of used nodes;
+** so all hashes (but booleans) are mixed first
+*/
+#define hashmix(t,n)	hashpow2(t, mixhash(n))
+
+#define hashstr(t,str)	hashmix(t, luaS_hash(str))
+#define hashboolean(t,p)	hashpow2(t, p)
+#define hashpointer(t,p)	hashmix(t, IntPoint(p))
+
+#define nextslot(t,i)	(((i) + 1) & (sizenode(t) - 1))
+
+
+#define dummynode		(&dummynode_)
+
+static const Node dummynode_ = {
+  {{NULL}, LUA_TNIL},  /* value */
+  {{{NULL}, LUA_TNIL}}  /* key */
+};
+
+
+static unsigned int mixhash (unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  return h ^ (h >> 16);
+}
+
+
+static int hashnum (const Table *t, lua_Number n) {
+  unsigned int a[numints];
+  int i;
+  if (luai_numeq(n, 0))  /* avoid problems with -0 */
+    return 0;
+  memcpy(a, &n, sizeof(a));
+  for (i = 1; i < numints; i++) a[0] += a[i];
+  return hashmix(t, a[0]);
+}
+
+
+/*
+** returns the index of the `main' position of an element in a table
+*/
+static int mainposition (const Table *t, const TValue *key) {
+  switch (ttype(key)) {
+    case LUA_TNUMBER:
+      return hashnum(t, nvalue(key));
+    case LUA_TSTRING:
+      return hashstr(t, rawtsvalue(key));
+    case LUA_TBOOLEAN:
+      return hashboolean(t, bvalue(key));
+    case LUA_TLIGHTUSERDATA:
+      return hashpointer(t, pvalue(key));
+    default:
+      return hashpointer(t, gcvalue(key));
+  }
+}
+
+
+/*
+** returns the node with key `key' (or NULL); with `dead' set, also
+** matches dead keys that were `key' (for traversals)
+*/
+static Node *findnode (const Table *t, const TValue *key, int dead) {
+  int i;
+  for (i = mainposition(t, key); !ttisnil(gkey(gnode(t, i)));
+       i = nextslot(t, i)) {
+    Node *n = gnode(t, i);
+    if (luaO_rawequalObj(key2tval(n), key) ||
+        (dead && ttype(gkey(n)) == LUA_TDEADKEY && iscollectable(key) &&
+         gcvalue(gkey(n)) == gcvalue(key)))
+      return n;
+  }
+  return NULL;
+}
+
+#endif
+
+
+
 /*
 ** returns the index for `key' if `key' is an appropriate key to live in
 ** the array part of the table, -1 otherwise.
 */
 static int arrayindex (const TValue *key) {
+#if defined(LUAI_INTSUBTYPE)
+  if (ttisint(key)) {
+    lua_Integer i = ivalue(key);
+    return (cast(lua_Integer, cast_int(i)) == i) ? cast_int(i) : -1;
+  }
+#endif
   if (ttisnumber(key)) {
     lua_Number n = nvalue(key);
     int k;
@@ -141,6 +248,7 @@ static int findindex (lua_State *L, Table *t, StkId key) {
   if (0 < i && i <= t->sizearray)  /* is `key' inside array part? */
     return i-1;  /* yes; that's the index (corrected to C) */
   else {
+#if !defined(LUAI_OPENHASH)
     Node *n = mainposition(t, key);
     do {  /* check whether `key' is somewhere in the chain */
       /* key may be dead already, but it is ok to use it in `next' */
@@ -153,6 +261,11 @@ static int findindex (lua_State *L, Table *t, StkId key) {
       }
       else n = gnext(n);
     } while (n);
+#else
+    Node *n = findnode(t, key, 1);  /* key may be dead already */
+    if (n != NULL)  /* hash elements are numbered after array ones */
+      return cast_int(n - gnode(t, 0)) + t->sizearray;
+#endif
     luaG_runerror(L, "invalid key to " LUA_QL("next"));  /* key not found */
     return 0;  /* to avoid warnings */
   }
@@ -163,7 +276,7 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
   int i = findindex(L, t, key);  /* find original element */
   for (i++; i < t->sizearray; i++) {  /* try first array part */
     if (!ttisnil(&t->array[i])) {  /* a non-nil value? */
-      setnvalue(key, cast_num(i+1));
+      setivalue(key, i+1);
       setobj2s(L, key+1, &t->array[i]);
       return 1;
     }
@@ -269,6 +382,8 @@ static void setarrayvector (lua_State *L, Table *t, int size) {
 }
 
 
+#if !defined(LUAI_OPENHASH)
+
 static void setnodevector (lua_State *L, Table *t, int size) {
   int lsize;
   if (size == 0) {  /* no elements to hash part? */
@@ -293,8 +408,35 @@ static void setnodevector (lua_State *L, Table *t, int size) {
   t->lastfree = gnode(t, size);  /* all positions are free */
 }
 
+#else
+
+static void setnodevector (lua_State *L, Table *t, int size) {
+  if (size == 0) {  /* no elements to hash part? */
+    t->node = cast(Node *, dummynode);  /* use common `dummynode' */
+    t->lsizenode = 0;
+    t->nfree = 0;  /* first insertion will rehash */
+  }
+  else {
+    int i;
+    int lsize = ceillog2(size + size/3 + 1);  /* room for 3/4 load */
+    if (lsize > MAXBITS)
+      luaG_runerror(L, "table overflow");
+    size = twoto(lsize);
+    t->node = luaM_newvector(L, size, Node);
+    t->lsizenode = cast_byte(lsize);
+    for (i=0; i<size; i++) {
+      Node *n = gnode(t, i);
+      setnilvalue(gkey(n));
+      setnilvalue(gval(n));
+    }
+    t->nfree = size - size/4 - 1;  /* keep at least one empty slot */
+  }
+}
+
+#endif
+
 
-static void resize (lua_State *L, Table *t, int nasize, int nhsize) {
+void luaH_resize (lua_State *L, Table *t, int nasize, int nhsize) {
   int i;
   int oldasize = t->sizearray;
   int oldhsize = t->lsizenode;
@@ -326,7 +468,7 @@ static void resize (lua_State *L, Table *t, int nasize, int nhsize) {
 
 void luaH_resizearray (lua_State *L, Table *t, int nasize) {
   int nsize = (t->node == dummynode) ? 0 : sizenode(t);
-  resize(L, t, nasize, nsize);
+  luaH_resize(L, t, nasize, nsize);
 }
 
 
@@ -345,7 +487,7 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
   /* compute new size for array part */
   na = computesizes(nums, &nasize);
   /* resize the table to new computed sizes */
-  resize(L, t, nasize, totaluse - na);
+  luaH_resize(L, t, nasize, totaluse - na);
 }
 
 
@@ -379,6 +521,8 @@ void luaH_free (lua_State *L, Table *t) {
 }
 
 
+#if !defined(LUAI_OPENHASH)
+
 static Node *getfreepos (Table *t) {
   while (t->lastfree-- > t->node) {
     if (ttisnil(gkey(t->lastfree)))
@@ -428,6 +572,43 @@ static TValue *newkey (lua_State *L, Table *t, const TValue *key) {
   return gval(mp);
 }
 
+#else
+
+/*
+** inserts a new key into a hash table. The key goes in the first node
+** of its run with a nil value: as the key is not in the table, it cannot
+** be further in the run. Only if that node is free does the table get
+** fuller.
+*/
+static TValue *newkey (lua_State *L, Table *t, const TValue *key) {
+  Node *n;
+  int i = mainposition(t, key);
+  while (!ttisnil(gval(n = gnode(t, i))))
+    i = nextslot(t, i);
+  if (ttisnil(gkey(n))) {  /* free node? */
+    if (t->nfree == 0) {  /* table is full? */
+      rehash(L, t, key);  /* grow table */
+      return luaH_set(L, t, key);  /* re-insert key into grown table */
+    }
+    t->nfree--;
+  }
+  gkey(n)->value = key->value; gkey(n)->tt = key->tt;
+  luaC_barriert(L, t, key);
+  lua_assert(ttisnil(gval(n)));
+  return gval(n);
+}
+
+#endif
+
+
+#if defined(LUAI_INTSUBTYPE)
+/* integer keys are compared exactly (see `luaO_numeq') */
+#define numkeyeq(k,i,ni) \
+	(ttisint(k) ? ivalue(k) == (i) : luai_numeq(nvalue(k), (ni)))
+#else
+#define numkeyeq(k,i,ni)	luai_numeq(nvalue(k), (ni))
+#endif
+
 
 /*
 ** search function for integers
@@ -438,12 +619,22 @@ const TValue *luaH_getnum (Table *t, int key) {
     return &t->array[key-1];
   else {
     lua_Number nk = cast_num(key);
+#if !defined(LUAI_OPENHASH)
     Node *n = hashnum(t, nk);
     do {  /* check whether `key' is somewhere in the chain */
-      if (ttisnumber(gkey(n)) && luai_numeq(nvalue(gkey(n)), nk))
+      if (ttisnumber(gkey(n)) && numkeyeq(gkey(n), key, nk))
         return gval(n);  /* that's it */
       else n = gnext(n);
     } while (n);
+#else
+    int i;
+    Node *n;
+    for (i = hashnum(t, nk); !ttisnil(gkey(n = gnode(t, i)));
+         i = nextslot(t, i)) {
+      if (ttisnumber(gkey(n)) && numkeyeq(gkey(n), key, nk))
+        return gval(n);  /* that's it */
+    }
+#endif
     return luaO_nilobject;
   }
 }
@@ -453,12 +644,22 @@ const TValue *luaH_getnum (Table *t, int key) {
 ** search function for strings
 */
 const TValue *luaH_getstr (Table *t, TString *key) {
+#if !defined(LUAI_OPENHASH)
   Node *n = hashstr(t, key);
   do {  /* check whether `key' is somewhere in the chain */
-    if (ttisstring(gkey(n)) && rawtsvalue(gkey(n)) == key)
+    if (ttisstring(gkey(n)) && luaS_eqstr(key, rawtsvalue(gkey(n))))
       return gval(n);  /* that's it */
     else n = gnext(n);
   } while (n);
+#else
+  int i;
+  Node *n;
+  for (i = hashstr(t, key); !ttisnil(gkey(n = gnode(t, i)));
+       i = nextslot(t, i)) {
+    if (ttisstring(gkey(n)) && luaS_eqstr(key, rawtsvalue(gkey(n))))
+      return gval(n);  /* that's it */
+  }
+#endif
   return luaO_nilobject;
 }
 
@@ -472,13 +673,19 @@ const TValue *luaH_get (Table *t, const TValue *key) {
     case LUA_TSTRING: return luaH_getstr(t, rawtsvalue(key));
     case LUA_TNUMBER: {
       int k;
-      lua_Number n = nvalue(key);
+      lua_Number n;
+#if defined(LUAI_INTSUBTYPE)
+      if (ttisint(key) && cast(lua_Integer, cast_int(ivalue(key))) == ivalue(key))
+        return luaH_getnum(t, cast_int(ivalue(key)));  /* index is int */
+#endif
+      n = nvalue(key);
       lua_number2int(k, n);
       if (luai_numeq(cast_num(k), nvalue(key))) /* index is int? */
         return luaH_getnum(t, k);  /* use specialized version */
       /* else go through */
     }
     default: {
+#if !defined(LUAI_OPENHASH)
       Node *n = mainposition(t, key);
       do {  /* check whether `key' is somewhere in the chain */
         if (luaO_rawequalObj(key2tval(n), key))
@@ -486,6 +693,10 @@ const TValue *luaH_get (Table *t, const TValue *key) {
         else n = gnext(n);
       } while (n);
       return luaO_nilobject;
+#else
+      Node *n = findnode(t, key, 0);
+      return (n != NULL) ? gval(n) : luaO_nilobject;
+#endif
     }
   }
 }
@@ -511,7 +722,7 @@ TValue *luaH_setnum (lua_State *L, Table *t, int key) {
     return cast(TValue *, p);
   else {
     TValue k;
-    setnvalue(&k, cast_num(key));
+    setivalue(&k, key);
     return newkey(L, t, &k);
   }
 }
@@ -579,9 +790,11 @@ int luaH_getn (Table *t) {
 
 #if defined(LUA_DEBUG)
 
+#if !defined(LUAI_OPENHASH)
 Node *luaH_mainposition (const Table *t, const TValue *key) {
   return mainposition(t, key);
 }
+#endif
 
 int luaH_isdummy (Node *n) { return n == dummynode; }
 
@@ -25,6 +25,7 @@ LUAI_FUNC TValue *luaH_setstr (lua_State *L, Table *t, TString *key);
 LUAI_FUNC const TValue *luaH_get (Table *t, const TValue *key);
 LUAI_FUNC TValue *luaH_set (lua_State *L, Table *t, const TValue *key);
 LUAI_FUNC Table *luaH_new (lua_State *L, int narray, int lnhash);
+LUAI_FUNC void luaH_resize (lua_State *L, Table *t, int nasize, int nhsize);
 LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, int nasize);
 LUAI_FUNC void luaH_free (lua_State *L, Table *t);
 LUAI_FUNC int luaH_next (lua_State *L, Table *t, StkId key);
@@ -32,7 +33,9 @@ LUAI_FUNC int luaH_getn (Table *t);
 
 
 #if defined(LUA_DEBUG)
+#if !defined(LUAI_OPENHASH)
 LUAI_FUNC Node *luaH_mainposition (const Table *t, const TValue *key);
+#endif
 LUAI_FUNC int luaH_isdummy (Node *n);
 #endif
 
@@ -66,6 +66,14 @@ typedef int (*lua_Writer) (lua_State *L, const void* p, size_t sz, void* ud);
 typedef void * (*lua_Alloc) (void *ud, void *ptr, size_t osize, size_t nsize);
 
 
+/*
+** prototype for functions that release the contents of external strings;
+** they run while the collector frees objects (or in `lua_close'), so
+** they must not call any function of the API
+*/
+typedef void (*lua_ExtFree) (void *ud, const char *s, size_t len);
+
+
 /*
 ** basic types
 */
@@ -109,7 +117,9 @@ typedef LUA_INTEGER lua_Integer;
 */
 LUA_API lua_State *(lua_newstate) (lua_Alloc f, void *ud);
 LUA_API void       (lua_close) (lua_State *L);
+LUA_API lua_State *(lua_clonestate) (lua_State *from, lua_Alloc f, void *ud);
 LUA_API lua_State *(lua_newthread) (lua_State *L);
+LUA_API int        (lua_stackpool) (lua_State *L, int n, int slots, int calls);
 
 LUA_API lua_CFunction (lua_atpanic) (lua_State *L, lua_CFunction panicf);
 
@@ -124,6 +134,7 @@ LUA_API void  (lua_remove) (lua_State *L, int idx);
 LUA_API void  (lua_insert) (lua_State *L, int idx);
 LUA_API void  (lua_replace) (lua_State *L, int idx);
 LUA_API int   (lua_checkstack) (lua_State *L, int sz);
+LUA_API int   (lua_reservestack) (lua_State *L, int slots, int calls);
 
 LUA_API void  (lua_xmove) (lua_State *from, lua_State *to, int n);
 
@@ -162,6 +173,8 @@ LUA_API void  (lua_pushnumber) (lua_State *L, lua_Number n);
 LUA_API void  (lua_pushinteger) (lua_State *L, lua_Integer n);
 LUA_API void  (lua_pushlstring) (lua_State *L, const char *s, size_t l);
 LUA_API void  (lua_pushstring) (lua_State *L, const char *s);
+LUA_API const char *(lua_pushexternalstring) (lua_State *L, const char *s,
+                                   size_t len, lua_ExtFree freefn, void *ud);
 LUA_API const char *(lua_pushvfstring) (lua_State *L, const char *fmt,
                                                       va_list argp);
 LUA_API const char *(lua_pushfstring) (lua_State *L, const char *fmt, ...);
@@ -191,6 +204,8 @@ LUA_API void  (lua_settable) (lua_State *L, int idx);
 LUA_API void  (lua_setfield) (lua_State *L, int idx, const char *k);
 LUA_API void  (lua_rawset) (lua_State *L, int idx);
 LUA_API void  (lua_rawseti) (lua_State *L, int idx, int n);
+LUA_API void  (lua_rawsetarray) (lua_State *L, int idx, int first, int n);
+LUA_API void  (lua_tableresize) (lua_State *L, int idx, int narr, int nhash);
 LUA_API int   (lua_setmetatable) (lua_State *L, int objindex);
 LUA_API int   (lua_setfenv) (lua_State *L, int idx);
 
@@ -213,6 +228,7 @@ LUA_API int (lua_dump) (lua_State *L, lua_Writer writer, void *data);
 LUA_API int  (lua_yield) (lua_State *L, int nresults);
 LUA_API int  (lua_resume) (lua_State *L, int narg);
 LUA_API int  (lua_status) (lua_State *L);
+LUA_API int  (lua_resetthread) (lua_State *L);
 
 /*
 ** garbage-collection function and options
@@ -226,9 +242,31 @@ LUA_API int  (lua_status) (lua_State *L);
 #define LUA_GCSTEP		5
 #define LUA_GCSETPAUSE		6
 #define LUA_GCSETSTEPMUL	7
+#define LUA_GCGEN		8
+#define LUA_GCINC		9
+#define LUA_GCSTEPTIME		10
+#define LUA_GCBGSWEEP		11
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
+/* collector statistics; times are in seconds, spent inside `lua_gc'
+   and automatic steps (they stay 0 unless LUAI_GCSTATS is defined) */
+typedef struct lua_GCStats {
+  unsigned long cycles;  /* completed collection cycles */
+  lua_Number propagate;  /* time in each phase of the collector */
+  lua_Number atomic;
+  lua_Number sweepstring;
+  lua_Number sweep;
+  lua_Number finalize;
+  lua_Number maxpause;  /* longest single collector step */
+  size_t freed;  /* bytes freed by last complete cycle */
+  size_t threshold;  /* collector runs when memory in use reaches this */
+  size_t estimate;  /* estimate of memory actually in use */
+} lua_GCStats;
+
+LUA_API void (lua_gcstats) (lua_State *L, lua_GCStats *s);
+LUA_API int (lua_strtabstats) (lua_State *L, unsigned long *hist, int n);
+
 
 /*
 ** miscellaneous functions
@@ -242,6 +280,9 @@ LUA_API void  (lua_concat) (lua_State *L, int n);
 
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
 LUA_API void lua_setallocf (lua_State *L, lua_Alloc f, void *ud);
+LUA_API void lua_setbulkfree (lua_State *L, int bulk);
+LUA_API void lua_setallocsafe (lua_State *L, int safe);
+LUA_API int lua_setjit (lua_State *L, int threshold);
 
 
 
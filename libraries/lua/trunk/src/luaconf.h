@@ -292,6 +292,69 @@
 /* }================================================================== */
 
 
+/*
+@@ LUAI_HASHFULL makes the hash of strings use all their characters.
+** CHANGE it (undefine it) to hash at most 32 characters of each string,
+** as older versions did. That is cheaper for very long strings, but
+** long strings that differ only in the skipped characters then all
+** fall in the same chain of the string table.
+*/
+#define LUAI_HASHFULL
+
+
+/*
+@@ LUAI_MAXSHORTLEN is the maximum length of strings kept in the string
+@* table. Longer strings are not interned nor hashed when created.
+** CHANGE it if you want a different limit; it must be at least the
+** length of the longest reserved word.
+*/
+#define LUAI_MAXSHORTLEN	40
+
+
+/*
+@@ LUAI_OPENHASH makes the hash part of tables use open addressing.
+** CHANGE it (define it) to use linear probing instead of chained nodes.
+** Nodes lose their `next' pointer and a search reads consecutive nodes,
+** but hash parts are kept at most 3/4 full, so some tables use more
+** memory. Both versions keep the same behavior, including for `next'.
+*/
+/* #define LUAI_OPENHASH */
+
+
+/*
+@@ LUAI_THREADEDCODE makes the interpreter use threaded dispatch.
+** CHANGE it (define it) if your compiler is GCC (or compatible) to have
+** each opcode in `luaV_execute' jump straight to the next one through
+** a table of label addresses ("labels as values"), instead of going
+** back to a single `switch'. It is ignored by other compilers.
+*/
+/* #define LUAI_THREADEDCODE */
+#if defined(LUAI_THREADEDCODE) && !defined(__GNUC__)
+#undef LUAI_THREADEDCODE
+#endif
+
+
+/*
+@@ LUAI_FUSEOPS makes the compiler emit superinstructions.
+** CHANGE it (undefine it) if your precompiled chunks must also run on
+** other Lua 5.1 interpreters, which do not know these opcodes. (This
+** interpreter runs chunks with and without them.)
+*/
+#define LUAI_FUSEOPS
+
+
+/*
+@@ luai_makeseed gives the seed for the hash of strings in a new state.
+** CHANGE it if you have a better source of randomness, or define it as
+** 0 if you need the same traversal order of tables in all runs.
+*/
+#if defined(lstate_c) || defined(luaall_c)
+#include <time.h>
+#define luai_makeseed(L)	((unsigned int)time(NULL) ^ \
+				 (unsigned int)(size_t)(L))
+#endif
+
+
 /*
 @@ LUAI_GCPAUSE defines the default pause between garbage-collector cycles
 @* as a percentage.
@@ -313,6 +376,52 @@
 #define LUAI_GCMUL	200 /* GC runs 'twice the speed' of memory allocation */
 
 
+/*
+@@ LUA_USE_BGSWEEP allows the collector to free dead objects in a helper
+@* thread (see option "bgsweep" of `collectgarbage').
+** CHANGE it (define it) if your system has POSIX threads. It needs an
+** extra library: -lpthread. The helper thread only starts in states
+** whose allocator is declared thread safe (see `lua_setallocsafe'), such
+** as those of `luaL_newstate' (but not `luaL_newpooledstate').
+*/
+/* #define LUA_USE_BGSWEEP */
+
+
+/*
+@@ LUAI_GCSTATS makes the collector time its phases for `lua_gcstats'.
+** CHANGE it (define it) to have the times filled in. Without it they
+** stay 0 (the other fields are always kept), as reading the clock
+** twice in each collector step slows down code that allocates a lot.
+@@ luai_gcclock sets `t' to the time, in seconds, used to measure
+@* collector steps (for LUAI_GCSTATS and `lua_gc' option LUA_GCSTEPTIME).
+** CHANGE it if you need a more precise clock. Under LUA_USE_POSIX it is
+** a monotonic wall clock, so that the time other OS threads take (see
+** LUA_USE_BGSWEEP and LUA_USE_LOCK) is not counted as collector time.
+*/
+/* #define LUAI_GCSTATS */
+
+#if defined(lgc_c) || defined(luaall_c)
+#include <time.h>
+#if defined(LUA_USE_POSIX) && defined(CLOCK_MONOTONIC)
+#define luai_gcclock(t)	{ struct timespec ts_; \
+  clock_gettime(CLOCK_MONOTONIC, &ts_); \
+  (t) = (lua_Number)ts_.tv_sec + (lua_Number)ts_.tv_nsec / 1e9; }
+#else
+#define luai_gcclock(t)	\
+  ((t) = (lua_Number)clock() / (lua_Number)CLOCKS_PER_SEC)
+#endif
+#endif
+
+
+/*
+@@ LUAI_GCMAJOR defines, for the generational mode, how much the memory in
+@* use may grow (as a percentage of its size after the last major
+@* collection) before the collector does a major collection.
+** CHANGE it if you want major collections to happen more or less often.
+*/
+#define LUAI_GCMAJOR	200 /* major collection when old memory doubles */
+
+
 
 /*
 @@ LUA_COMPAT_GETN controls compatibility with old getn behavior.
@@ -487,6 +596,32 @@
 */
 #define LUAL_BUFFERSIZE		BUFSIZ
 
+
+/*
+@@ LUAL_BUFFERGROW makes a lauxlib buffer grow as one block.
+** CHANGE it (define it) to have a buffer that outgrows LUAL_BUFFERSIZE
+** move to a block that doubles as needed (kept by a userdata in the
+** stack), so that 'luaL_pushresult' creates one string, instead of
+** pushing full buffers into the stack as strings and concatenating them
+** at the end. It changes the layout of 'luaL_Buffer' and the macro
+** 'luaL_addchar', so all C modules must be rebuilt with it: modules
+** built for standard Lua 5.1 would have the library write past the end
+** of their buffers.
+*/
+/* #define LUAL_BUFFERGROW */
+
+
+/*
+@@ LUAL_POOLMAXSIZE is the largest block served from the size-class
+@* free lists of 'luaL_newpooledstate'; larger blocks use 'realloc'.
+@@ LUAL_POOLCHUNKSIZE is the size of each slab the pool carves from.
+** CHANGE them if your allocation profile is dominated by other sizes.
+** (LUAL_POOLCHUNKSIZE must be a multiple of the maximum alignment and
+** much larger than LUAL_POOLMAXSIZE.)
+*/
+#define LUAL_POOLMAXSIZE	256
+#define LUAL_POOLCHUNKSIZE	(16*1024)
+
 /* }================================================================== */
 
 
@@ -582,9 +717,44 @@ union luai_Cast { double l_d; long l_l; };
 
 #endif
 
+
+/*
+@@ LUAI_INTSUBTYPE gives numbers an integer subtype.
+** CHANGE it (define it) to keep integral numbers as lua_Integer values
+** where that is cheap: integer constants, 'for' loops with integer
+** limits, lengths, lua_pushinteger and the results of +, -, *, % and
+** unary minus over integers. They behave as the equivalent doubles,
+** but make array indexing and loops cheaper and stay exact beyond
+** 2^53 (up to the size of LUA_INTEGER). Integer zeros have no sign.
+@@ lua_integer2str converts an integer to a string.
+** CHANGE it if LUA_INTFRM_T is smaller than LUA_INTEGER in your system.
+*/
+/* #define LUAI_INTSUBTYPE */
+#define lua_integer2str(s,n) \
+	sprintf((s), "%" LUA_INTFRMLEN "d", (LUA_INTFRM_T)(n))
+
 /* }================================================================== */
 
 
+/*
+@@ LUA_USE_JIT compiles hot Lua functions to native code.
+** CHANGE it (define it) to have functions called more than
+** LUAI_JITTHRESHOLD times translated to x86-64 code, which the
+** interpreter runs instead of their bytecodes while no line or count
+** hook is set (see `lua_setjit'). It works only with GCC (or compatible)
+** on x86-64 POSIX systems, with the default `lua_Number', when Lua is
+** compiled as C and without LUAI_INTSUBTYPE; elsewhere it is ignored.
+@@ LUAI_JITTHRESHOLD is the default number of calls before compiling.
+*/
+/* #define LUA_USE_JIT */
+#define LUAI_JITTHRESHOLD	50
+#if defined(LUA_USE_JIT) && (!defined(__x86_64__) || !defined(__GNUC__) || \
+    !defined(LUA_USE_POSIX) || defined(__cplusplus) || \
+    !defined(LUA_NUMBER_DOUBLE) || defined(LUAI_INTSUBTYPE))
+#undef LUA_USE_JIT
+#endif
+
+
 /*
 @@ LUAI_USER_ALIGNMENT_T is a type that requires maximum alignment.
 ** CHANGE it if your system requires alignments larger than double. (For
@@ -633,6 +803,36 @@ union luai_Cast { double l_d; long l_l; };
 #define LUA_MAXCAPTURES		32
 
 
+/*
+@@ LUAI_PATCOMPILE makes the string library compile patterns.
+** CHANGE it (undefine it) to have 'find', 'match', 'gmatch' and 'gsub'
+** interpret each pattern anew in every call. Compiled patterns (with
+** their character sets as bitmaps) are kept in a weak cache, so they
+** last until the next collection.
+*/
+#define LUAI_PATCOMPILE
+
+
+/*
+@@ LUAI_SSE2FIND makes searches for plain strings use SSE2 instructions.
+** CHANGE it (undefine it) to use only the portable search, which checks
+** the first and last chars of each candidate before the others. By
+** default it is on where GCC (or compatible) targets SSE2 (all x86-64).
+*/
+#if defined(__SSE2__) && defined(__GNUC__) && !defined(LUA_ANSI)
+#define LUAI_SSE2FIND
+#endif
+
+
+/*
+@@ LUAI_FMTCOMPILE makes 'string.format' cache parsed formats.
+** CHANGE it (undefine it) to have 'string.format' parse its format anew
+** in every call and use 'sprintf' for every item. Parsed formats also
+** let bare '%d', '%x', '%s', '%g' and '%.Nf' items skip 'sprintf'.
+*/
+#define LUAI_FMTCOMPILE
+
+
 /*
 @@ lua_tmpnam is the function that the OS library uses to create a
 @* temporary name.
@@ -728,6 +928,32 @@ union luai_Cast { double l_d; long l_l; };
 #define luai_userstateyield(L,n)	((void)L)
 
 
+/*
+@@ LUA_USE_LOCK makes `lua_lock' lock the state with a mutex.
+** CHANGE it (define it) to let several OS threads run their own threads
+** (or coroutines) of the same state. Lua code still runs in one OS
+** thread at a time: the lock is released while C functions run, and the
+** running thread lets waiting ones in at jumps (see `luai_threadyield').
+** Taking a free lock costs one atomic operation; waiting uses a futex,
+** so the option needs Linux and GCC and is ignored elsewhere. It turns
+** off LUA_USE_JIT, whose loops would not let other threads in.
+*/
+/* #define LUA_USE_LOCK */
+#if defined(LUA_USE_LOCK)
+#if defined(__linux__) && defined(__GNUC__)
+#define lua_lock(L)	((void)(__sync_bool_compare_and_swap(&G(L)->lock, 0, 1) \
+				|| (luaE_lock(L), 0)))
+#define lua_unlock(L)	((void)(__sync_fetch_and_sub(&G(L)->lock, 1) == 1 \
+				|| (luaE_unlock(L), 0)))
+#define luai_threadyield(L)	((void)(__atomic_load_n(&G(L)->lock, \
+				__ATOMIC_RELAXED) == 2 && (luaE_yield(L), 1)))
+#undef LUA_USE_JIT
+#else
+#undef LUA_USE_LOCK
+#endif
+#endif
+
+
 /*
 @@ LUA_INTFRMLEN is the length modifier for integer conversions
 @* in 'string.format'.
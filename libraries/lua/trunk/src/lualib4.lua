@@ -19,6 +19,29 @@ newoption
 	trigger = "lua-cpp",
 	description = "Compile Lua library as C++ code."
 }
+newoption
+{
+	trigger = "lua-bgsweep",
+	description = "Let the garbage collector free memory in a helper thread (needs pthreads)."
+}
+
+newoption
+{
+	trigger = "lua-lock",
+	description = "Let several OS threads share a state through a built-in lock (Linux, GCC only)."
+}
+
+newoption
+{
+	trigger = "lua-jit",
+	description = "Compile hot Lua functions to native code (x86-64 POSIX, GCC only)."
+}
+
+newoption
+{
+	trigger = "lua-buffergrow",
+	description = "Grow lauxlib buffers as one block (changes luaL_Buffer: rebuild all C modules)."
+}
 
 
 -- GENERAL SETUP -------------------------------------------------------------
@@ -65,6 +88,23 @@ if _ACTION and _ACTION:find( "vs20*" ) then
 	buildoptions( "/MP" )
 end
 
+if ( _OPTIONS["lua-bgsweep"] ) then
+	defines { "LUA_USE_BGSWEEP" }
+	links { "pthread" }
+end
+
+if ( _OPTIONS["lua-lock"] ) then
+	defines { "LUA_USE_LOCK" }
+end
+
+if ( _OPTIONS["lua-jit"] ) then
+	defines { "LUA_USE_JIT" }
+end
+
+if ( _OPTIONS["lua-buffergrow"] ) then
+	defines { "LUAL_BUFFERGROW" }
+end
+
 -- OPERATING SYSTEM SPECIFIC SETTINGS -----------------------------------------
 --
 if ( os.get() == "windows" ) then											-- WINDOWS
@@ -182,6 +182,44 @@ namespace lua
 	typedef lua_Integer integer;
 	typedef lua_Number number;
 	typedef lua_Reader reader;
+	typedef lua_ExtFree extfree;
+
+	/** A view of characters that Lua uses without copying them.
+	 * The characters must be followed by a '\0' and must stay valid until
+	 * Lua calls @p freefn (or, without a @p freefn, while Lua may use the
+	 * string).
+	 * @see state::push( const external_string& )
+	 */
+	class external_string
+	{
+	public:
+		/// Constructor.
+		external_string( const char* s, size_t length, extfree freefn = NULL, void* ud = NULL ) :
+			data( s ), size( length ), freefn( freefn ), ud( ud ) { }
+
+		/// Refers to the characters of @p s, which must outlive the Lua string.
+		explicit external_string( const std::string& s ) :
+			data( s.c_str() ), size( s.size() ), freefn( NULL ), ud( NULL ) { }
+
+		/** Makes Lua own @p s, which is deleted when Lua collects the string.
+		 * @param s a string allocated with new
+		 */
+		static external_string owned( std::string* s )
+		{
+			return external_string( s->c_str(), s->size(), delete_string, s );
+		}
+
+		const char* data;
+		size_t size;
+		extfree freefn;
+		void* ud;
+
+	private:
+		static void delete_string( void* ud, const char*, size_t )
+		{
+			delete static_cast< std::string* >( ud );
+		}
+	};
 
 	const int multiret = LUA_MULTRET;
 
@@ -363,6 +401,17 @@ namespace lua
 			return *this;
 		}
 
+		/** Push a string whose characters are not copied.
+		 * @param s the string to push
+		 * @see lua_pushexternalstring
+		 * @returns a reference to this lua::state
+		 */
+		state& push( const external_string& s )
+		{
+			lua_pushexternalstring( L, s.data, s.size, s.freefn, s.ud );
+			return *this;
+		}
+
 		/** Push an C function onto the stack.
 		 * @param f the function to push
 		 * @returns a reference to this lua::state
@@ -434,7 +483,7 @@ namespace lua
 		template< typename T, typename U >
 		state& push( const std::pair< T, U >& p )
 		{
-			lua_newtable( L );
+			lua_createtable( L, 0, 1 );
 			push( p.first );									// index
 			push( p.second );									// value, which is a std::pair
 			lua_settable( L, -3 );								// p[index] = v.at( i )
@@ -448,13 +497,12 @@ namespace lua
 		template< typename T >
 		state& push( const std::vector< T >& v )
 		{
-			lua_newtable( L );
+			lua_createtable( L, static_cast< int >( v.size() ), 0 );
 			for ( size_t i = 0; i < v.size(); ++i )
 			{
-				// Lua expects the index to start a 1 not 0.
-				push( i + 1 );									// index
 				push( v[i] );									// value
-				lua_settable( L, -3 );							// v[i] = v.at( i )
+				// Lua expects the index to start a 1 not 0.
+				lua_rawseti( L, -2, static_cast< int >( i + 1 ) );	// v[i] = v.at( i )
 			}
 
 			return *this;
@@ -491,7 +539,7 @@ namespace lua
 		template< typename T, typename U, typename V, typename W >
 		state& push( const std::map< T, U, V, W >& m )
 		{
-			lua_newtable( L );
+			lua_createtable( L, 0, static_cast< int >( m.size() ) );
 			std::for_each( m.begin(), m.end(), MapPusher< T, U >( this ) );
 			return *this;
 		}
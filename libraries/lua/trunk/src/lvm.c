@@ -18,6 +18,7 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
@@ -50,6 +51,12 @@ int luaV_tostring (lua_State *L, StkId obj) {
   else {
     char s[LUAI_MAXNUMBER2STR];
     lua_Number n = nvalue(obj);
+#if defined(LUAI_INTSUBTYPE)
+    /* integers that a double cannot represent are written in full */
+    if (ttisint(obj) && !(numfitsint(n) && cast(lua_Integer, n) == ivalue(obj)))
+      lua_integer2str(s, ivalue(obj));
+    else
+#endif
     lua_number2str(s, n);
     setsvalue2s(L, obj, luaS_new(L, s));
     return 1;
@@ -131,6 +138,57 @@ void luaV_gettable (lua_State *L, const TValue *t, TValue *key, StkId val) {
 }
 
 
+/*
+** Primitive get of a constant string key with an inline cache: `*cache'
+** is the index of the node where the instruction last found its key (in
+** any table). The node is checked before use, so a stale index (other
+** table, rehash, etc.) only costs a normal lookup.
+*/
+static const TValue *getcached (Table *h, TString *key, int *cache) {
+  const TValue *res;
+  if (*cache < sizenode(h)) {
+    Node *n = gnode(h, *cache);
+    if (ttisstring(gkey(n)) && rawtsvalue(gkey(n)) == key)
+      return gval(n);
+  }
+  res = luaH_getstr(h, key);
+  if (!ttisnil(res))  /* found in the node vector? */
+    *cache = cast_int(cast(const Node *, res) - gnode(h, 0));
+  return res;
+}
+
+
+/*
+** same as `luaV_gettable', for a constant string key
+*/
+void luaV_getfield (lua_State *L, const TValue *t, TValue *key, StkId val,
+                    int *cache) {
+  int loop;
+  lua_assert(ttisstring(key));
+  for (loop = 0; loop < MAXTAGLOOP; loop++) {
+    const TValue *tm;
+    if (ttistable(t)) {  /* `t' is a table? */
+      Table *h = hvalue(t);
+      const TValue *res = getcached(h, rawtsvalue(key), cache);
+      if (!ttisnil(res) ||  /* result is no nil? */
+          (tm = fasttm(L, h->metatable, TM_INDEX)) == NULL) { /* or no TM? */
+        setobj2s(L, val, res);
+        return;
+      }
+      /* else will try the tag method */
+    }
+    else if (ttisnil(tm = luaT_gettmbyobj(L, t, TM_INDEX)))
+      luaG_typeerror(L, t, "index");
+    if (ttisfunction(tm)) {
+      callTMres(L, val, tm, t, key);
+      return;
+    }
+    t = tm;  /* else repeat with `tm' */ 
+  }
+  luaG_runerror(L, "loop in gettable");
+}
+
+
 void luaV_settable (lua_State *L, const TValue *t, TValue *key, StkId val) {
   int loop;
   TValue temp;
@@ -222,12 +280,24 @@ static int l_strcmp (const TString *ls, const TString *rs) {
 }
 
 
+/* order of two numbers */
+#if defined(LUAI_INTSUBTYPE)
+#define numlt(l,r)	((ttisint(l) && ttisint(r)) ? ivalue(l) < ivalue(r) : \
+			 luai_numlt(nvalue(l), nvalue(r)))
+#define numle(l,r)	((ttisint(l) && ttisint(r)) ? ivalue(l) <= ivalue(r) : \
+			 luai_numle(nvalue(l), nvalue(r)))
+#else
+#define numlt(l,r)	luai_numlt(nvalue(l), nvalue(r))
+#define numle(l,r)	luai_numle(nvalue(l), nvalue(r))
+#endif
+
+
 int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
   int res;
   if (ttype(l) != ttype(r))
     return luaG_ordererror(L, l, r);
   else if (ttisnumber(l))
-    return luai_numlt(nvalue(l), nvalue(r));
+    return numlt(l, r);
   else if (ttisstring(l))
     return l_strcmp(rawtsvalue(l), rawtsvalue(r)) < 0;
   else if ((res = call_orderTM(L, l, r, TM_LT)) != -1)
@@ -236,12 +306,12 @@ int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
 }
 
 
-static int lessequal (lua_State *L, const TValue *l, const TValue *r) {
+int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r) {
   int res;
   if (ttype(l) != ttype(r))
     return luaG_ordererror(L, l, r);
   else if (ttisnumber(l))
-    return luai_numle(nvalue(l), nvalue(r));
+    return numle(l, r);
   else if (ttisstring(l))
     return l_strcmp(rawtsvalue(l), rawtsvalue(r)) <= 0;
   else if ((res = call_orderTM(L, l, r, TM_LE)) != -1)  /* first try `le' */
@@ -257,9 +327,10 @@ int luaV_equalval (lua_State *L, const TValue *t1, const TValue *t2) {
   lua_assert(ttype(t1) == ttype(t2));
   switch (ttype(t1)) {
     case LUA_TNIL: return 1;
-    case LUA_TNUMBER: return luai_numeq(nvalue(t1), nvalue(t2));
+    case LUA_TNUMBER: return luaO_numeq(t1, t2);
     case LUA_TBOOLEAN: return bvalue(t1) == bvalue(t2);  /* true must be 1 !! */
     case LUA_TLIGHTUSERDATA: return pvalue(t1) == pvalue(t2);
+    case LUA_TSTRING: return luaS_eqstr(rawtsvalue(t1), rawtsvalue(t2));
     case LUA_TUSERDATA: {
       if (uvalue(t1) == uvalue(t2)) return 1;
       tm = get_compTM(L, uvalue(t1)->metatable, uvalue(t2)->metatable,
@@ -314,8 +385,8 @@ void luaV_concat (lua_State *L, int total, int last) {
 }
 
 
-static void Arith (lua_State *L, StkId ra, const TValue *rb,
-                   const TValue *rc, TMS op) {
+void luaV_arith (lua_State *L, StkId ra, const TValue *rb,
+                 const TValue *rc, TMS op) {
   TValue tempb, tempc;
   const TValue *b, *c;
   if ((b = luaV_tonumber(rb, &tempb)) != NULL &&
@@ -355,11 +426,90 @@ static void Arith (lua_State *L, StkId ra, const TValue *rb,
 #define KBx(i)	check_exp(getBMode(GET_OPCODE(i)) == OpArgK, k+GETARG_Bx(i))
 
 
+/*
+** a jump may hand the lock over to another OS thread, whose collector may
+** reallocate this stack: `base' is reloaded after it and `ra' (computed
+** again at the next fetch) must not be used after a `dojump'
+*/
+#if defined(LUA_USE_LOCK)
+#define dojump(L,pc,i)	{(pc) += (i); Protect(luai_threadyield(L));}
+#else
 #define dojump(L,pc,i)	{(pc) += (i); luai_threadyield(L);}
+#endif
+
+
+/* decode the next instruction (calling the hooks before it) */
+#define vmfetch()	{ \
+  i = *pc++; \
+  if ((L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) && \
+      (--L->hookcount == 0 || L->hookmask & LUA_MASKLINE)) { \
+    traceexec(L, pc); \
+    if (L->status == LUA_YIELD) {  /* did hook yield? */ \
+      L->savedpc = pc - 1; \
+      return; \
+    } \
+    base = L->base; \
+  } \
+  /* warning!! several calls may realloc the stack and invalidate `ra' */ \
+  ra = RA(i); \
+  lua_assert(base == L->base && L->base == L->ci->base); \
+  lua_assert(base <= L->top && L->top <= L->stack + L->stacksize); \
+  lua_assert(L->top == L->ci->top || luaG_checkopenop(i)); }
+
+/*
+** with threaded code, each opcode ends fetching the next instruction and
+** jumping to its code, so that there is one indirect jump per opcode
+** (easier to predict than the single one of the `switch'); the `switch'
+** is still there for the `break's of `runtime_check'
+*/
+#if defined(LUAI_THREADEDCODE)
+#define vmdispatch(o)	goto *disptab[o]; switch (o)
+#define vmcase(op)	case op: L_##op:
+#define vmbreak		{ vmfetch(); goto *disptab[GET_OPCODE(i)]; }
+#else
+#define vmdispatch(o)	switch (o)
+#define vmcase(op)	case op:
+#define vmbreak		continue
+#endif
 
 
 #define Protect(x)	{ L->savedpc = pc; {x;}; base = L->base; }
 
+/* go on with the OP_GETTABLE that follows a superinstruction */
+#define nextgettable()	{ \
+  i = *pc++; \
+  lua_assert(GET_OPCODE(i) == OP_GETTABLE); \
+  ra = RA(i); \
+  goto gettable; }
+
+/* ends an opcode that native code leaves to the interpreter */
+#if defined(LUA_USE_JIT)
+#define jitbreak	{ \
+  if (cl->p->jit != NULL && luaJ_on(L)) { L->savedpc = pc; goto reentry; } \
+  vmbreak; }
+#else
+#define jitbreak	vmbreak
+#endif
+
+/* inline cache of the current instruction */
+#define ICACHE		(cl->p->cache + (pc - cl->p->code) - 1)
+
+/*
+** field access with a constant string key; a hit in the cache of a
+** table (with a non-nil value) is handled here, without a call
+*/
+#define getfield_op(t,key) { \
+  const TValue *t_ = (t); \
+  int *c_ = ICACHE; \
+  Node *n_; \
+  if (ttistable(t_) && *c_ < sizenode(hvalue(t_)) && \
+      (n_ = gnode(hvalue(t_), *c_), ttisstring(gkey(n_))) && \
+      rawtsvalue(gkey(n_)) == rawtsvalue(key) && !ttisnil(gval(n_))) { \
+    setobj2s(L, ra, gval(n_)); \
+  } \
+  else \
+    Protect(luaV_getfield(L, t_, key, ra, c_)); }
+
 
 #define arith_op(op,tm) { \
         TValue *rb = RKB(i); \
@@ -369,157 +519,270 @@ static void Arith (lua_State *L, StkId ra, const TValue *rb,
           setnvalue(ra, op(nb, nc)); \
         } \
         else \
-          Protect(Arith(L, ra, rb, rc, tm)); \
+          Protect(luaV_arith(L, ra, rb, rc, tm)); \
       }
 
 
+#if defined(LUAI_INTSUBTYPE)
+/*
+** `arith_op' for operations that keep integers (`op' works both on
+** lua_Number and lua_Integer); a result that may not fit in an integer
+** is kept as a double
+*/
+#define int_op(op,tm) { \
+        TValue *rb = RKB(i); \
+        TValue *rc = RKC(i); \
+        if (ttisint(rb) && ttisint(rc)) { \
+          lua_Integer ib = ivalue(rb), ic = ivalue(rc); \
+          lua_Number r = op(cast_num(ib), cast_num(ic)); \
+          if (numfitsint(r)) \
+            setivalue(ra, op(ib, ic)) \
+          else \
+            setnvalue(ra, r); \
+        } \
+        else if (ttisnumber(rb) && ttisnumber(rc)) { \
+          lua_Number nb = nvalue(rb), nc = nvalue(rc); \
+          setnvalue(ra, op(nb, nc)); \
+        } \
+        else \
+          Protect(luaV_arith(L, ra, rb, rc, tm)); \
+      }
+
+/* integer `k' is an index in the array part of `h' */
+#define inarray(h,k)	(1 <= (k) && (k) <= (h)->sizearray)
+#else
+#define int_op(op,tm)	arith_op(op,tm)
+#endif
+
+
 
 void luaV_execute (lua_State *L, int nexeccalls) {
   LClosure *cl;
   StkId base;
   TValue *k;
   const Instruction *pc;
+  Instruction i;
+  StkId ra;
+#if defined(LUAI_THREADEDCODE)
+  /* in the order of `OpCode' (see lopcodes.h) */
+  static const void *const disptab[NUM_OPCODES] = {
+    &&L_OP_MOVE, &&L_OP_LOADK, &&L_OP_LOADBOOL, &&L_OP_LOADNIL,
+    &&L_OP_GETUPVAL, &&L_OP_GETGLOBAL, &&L_OP_GETTABLE, &&L_OP_SETGLOBAL,
+    &&L_OP_SETUPVAL, &&L_OP_SETTABLE, &&L_OP_NEWTABLE, &&L_OP_SELF,
+    &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV, &&L_OP_MOD, &&L_OP_POW,
+    &&L_OP_UNM, &&L_OP_NOT, &&L_OP_LEN, &&L_OP_CONCAT, &&L_OP_JMP,
+    &&L_OP_EQ, &&L_OP_LT, &&L_OP_LE, &&L_OP_TEST, &&L_OP_TESTSET,
+    &&L_OP_CALL, &&L_OP_TAILCALL, &&L_OP_RETURN, &&L_OP_FORLOOP,
+    &&L_OP_FORPREP, &&L_OP_TFORLOOP, &&L_OP_SETLIST, &&L_OP_CLOSE,
+    &&L_OP_CLOSURE, &&L_OP_VARARG, &&L_OP_GETGINDEX, &&L_OP_GETUINDEX,
+    &&L_OP_GETTINDEX
+  };
+#endif
  reentry:  /* entry point */
   lua_assert(isLua(L->ci));
   pc = L->savedpc;
   cl = &clvalue(L->ci->func)->l;
   base = L->base;
   k = cl->p->k;
-  /* main loop of interpreter */
-  for (;;) {
-    const Instruction i = *pc++;
-    StkId ra;
-    if ((L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) &&
-        (--L->hookcount == 0 || L->hookmask & LUA_MASKLINE)) {
-      traceexec(L, pc);
-      if (L->status == LUA_YIELD) {  /* did hook yield? */
-        L->savedpc = pc - 1;
-        return;
-      }
+#if defined(LUA_USE_JIT)
+  if (luaJ_on(L)) {
+    Proto *p = cl->p;
+    if (p->jit == NULL && pc == p->code && luaJ_hot(L, p))
+      luaJ_compile(L, p);
+    if (p->jit != NULL) {
+      pc = luaJ_run(L, cl, pc);  /* runs until an opcode it does not do */
       base = L->base;
     }
-    /* warning!! several calls may realloc the stack and invalidate `ra' */
-    ra = RA(i);
-    lua_assert(base == L->base && L->base == L->ci->base);
-    lua_assert(base <= L->top && L->top <= L->stack + L->stacksize);
-    lua_assert(L->top == L->ci->top || luaG_checkopenop(i));
-    switch (GET_OPCODE(i)) {
-      case OP_MOVE: {
+  }
+#endif
+  /* main loop of interpreter */
+  for (;;) {
+    vmfetch();
+    vmdispatch(GET_OPCODE(i)) {
+      vmcase(OP_MOVE) {
         setobjs2s(L, ra, RB(i));
-        continue;
+        vmbreak;
       }
-      case OP_LOADK: {
+      vmcase(OP_LOADK) {
         setobj2s(L, ra, KBx(i));
-        continue;
+        vmbreak;
       }
-      case OP_LOADBOOL: {
+      vmcase(OP_LOADBOOL) {
         setbvalue(ra, GETARG_B(i));
         if (GETARG_C(i)) pc++;  /* skip next instruction (if C) */
-        continue;
+        vmbreak;
       }
-      case OP_LOADNIL: {
+      vmcase(OP_LOADNIL) {
         TValue *rb = RB(i);
         do {
           setnilvalue(rb--);
         } while (rb >= ra);
-        continue;
+        jitbreak;
       }
-      case OP_GETUPVAL: {
+      vmcase(OP_GETUPVAL) {
         int b = GETARG_B(i);
         setobj2s(L, ra, cl->upvals[b]->v);
-        continue;
+        vmbreak;
+      }
+      vmcase(OP_GETUINDEX) {  /* OP_GETUPVAL + OP_GETTABLE (see `luaK_fuse') */
+        setobj2s(L, ra, cl->upvals[GETARG_B(i)]->v);
+        nextgettable();
       }
-      case OP_GETGLOBAL: {
+      vmcase(OP_GETGLOBAL) {
         TValue g;
         TValue *rb = KBx(i);
         sethvalue(L, &g, cl->env);
-        lua_assert(ttisstring(rb));
-        Protect(luaV_gettable(L, &g, rb, ra));
-        continue;
+        getfield_op(&g, rb);
+        vmbreak;
+      }
+      vmcase(OP_GETGINDEX) {  /* OP_GETGLOBAL + OP_GETTABLE (see `luaK_fuse') */
+        TValue g;
+        sethvalue(L, &g, cl->env);
+        getfield_op(&g, KBx(i));
+        nextgettable();
       }
-      case OP_GETTABLE: {
-        Protect(luaV_gettable(L, RB(i), RKC(i), ra));
-        continue;
+      vmcase(OP_GETTINDEX) {  /* OP_GETTABLE + OP_GETTABLE (see `luaK_fuse') */
+        TValue *rc = RKC(i);
+        if (ISK(GETARG_C(i)) && ttisstring(rc))
+          getfield_op(RB(i), rc)
+        else
+          Protect(luaV_gettable(L, RB(i), rc, ra));
+        nextgettable();
       }
-      case OP_SETGLOBAL: {
+      vmcase(OP_GETTABLE)
+      gettable: {
+        TValue *rc = RKC(i);
+        if (ISK(GETARG_C(i)) && ttisstring(rc))
+          getfield_op(RB(i), rc)
+        else {
+#if defined(LUAI_INTSUBTYPE)
+          TValue *rb = RB(i);
+          if (ttisint(rc) && ttistable(rb) && inarray(hvalue(rb), ivalue(rc))) {
+            const TValue *v = &hvalue(rb)->array[ivalue(rc) - 1];
+            if (!ttisnil(v)) {
+              setobj2s(L, ra, v);
+              vmbreak;
+            }
+          }
+#endif
+          Protect(luaV_gettable(L, RB(i), rc, ra));
+        }
+        vmbreak;
+      }
+      vmcase(OP_SETGLOBAL) {
         TValue g;
         sethvalue(L, &g, cl->env);
         lua_assert(ttisstring(KBx(i)));
         Protect(luaV_settable(L, &g, KBx(i), ra));
-        continue;
+        vmbreak;
       }
-      case OP_SETUPVAL: {
+      vmcase(OP_SETUPVAL) {
         UpVal *uv = cl->upvals[GETARG_B(i)];
         setobj(L, uv->v, ra);
         luaC_barrier(L, uv, ra);
-        continue;
+        vmbreak;
       }
-      case OP_SETTABLE: {
+      vmcase(OP_SETTABLE) {
+#if defined(LUAI_INTSUBTYPE)
+        TValue *rb = RKB(i);
+        if (ttisint(rb) && ttistable(ra) && inarray(hvalue(ra), ivalue(rb))) {
+          Table *h = hvalue(ra);
+          TValue *v = &h->array[ivalue(rb) - 1];
+          if (!ttisnil(v) || fasttm(L, h->metatable, TM_NEWINDEX) == NULL) {
+            TValue *rc = RKC(i);
+            setobj2t(L, v, rc);
+            h->flags = 0;
+            luaC_barriert(L, h, rc);
+            vmbreak;
+          }
+        }
+#endif
         Protect(luaV_settable(L, ra, RKB(i), RKC(i)));
-        continue;
+        vmbreak;
       }
-      case OP_NEWTABLE: {
+      vmcase(OP_NEWTABLE) {
         int b = GETARG_B(i);
         int c = GETARG_C(i);
         sethvalue(L, ra, luaH_new(L, luaO_fb2int(b), luaO_fb2int(c)));
         Protect(luaC_checkGC(L));
-        continue;
+        jitbreak;
       }
-      case OP_SELF: {
+      vmcase(OP_SELF) {
         StkId rb = RB(i);
+        TValue *rc = RKC(i);
         setobjs2s(L, ra+1, rb);
-        Protect(luaV_gettable(L, rb, RKC(i), ra));
-        continue;
+        if (ISK(GETARG_C(i)) && ttisstring(rc))
+          getfield_op(rb, rc)
+        else
+          Protect(luaV_gettable(L, rb, rc, ra));
+        vmbreak;
       }
-      case OP_ADD: {
-        arith_op(luai_numadd, TM_ADD);
-        continue;
+      vmcase(OP_ADD) {
+        int_op(luai_numadd, TM_ADD);
+        vmbreak;
       }
-      case OP_SUB: {
-        arith_op(luai_numsub, TM_SUB);
-        continue;
+      vmcase(OP_SUB) {
+        int_op(luai_numsub, TM_SUB);
+        vmbreak;
       }
-      case OP_MUL: {
-        arith_op(luai_nummul, TM_MUL);
-        continue;
+      vmcase(OP_MUL) {
+        int_op(luai_nummul, TM_MUL);
+        vmbreak;
       }
-      case OP_DIV: {
+      vmcase(OP_DIV) {
         arith_op(luai_numdiv, TM_DIV);
-        continue;
+        vmbreak;
       }
-      case OP_MOD: {
+      vmcase(OP_MOD) {
+#if defined(LUAI_INTSUBTYPE)
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisint(rb) && ttisint(rc) && ivalue(rc) != 0 && ivalue(rc) != -1) {
+          lua_Integer ic = ivalue(rc);
+          lua_Integer r = ivalue(rb) % ic;
+          if (r != 0 && (r < 0) != (ic < 0)) r += ic;  /* round to -inf */
+          setivalue(ra, r);
+          vmbreak;
+        }
+#endif
         arith_op(luai_nummod, TM_MOD);
-        continue;
+        vmbreak;
       }
-      case OP_POW: {
+      vmcase(OP_POW) {
         arith_op(luai_numpow, TM_POW);
-        continue;
+        vmbreak;
       }
-      case OP_UNM: {
+      vmcase(OP_UNM) {
         TValue *rb = RB(i);
+#if defined(LUAI_INTSUBTYPE)
+        if (ttisint(rb) && numfitsint(cast_num(ivalue(rb)))) {
+          setivalue(ra, -ivalue(rb));
+        }
+        else
+#endif
         if (ttisnumber(rb)) {
           lua_Number nb = nvalue(rb);
           setnvalue(ra, luai_numunm(nb));
         }
         else {
-          Protect(Arith(L, ra, rb, rb, TM_UNM));
+          Protect(luaV_arith(L, ra, rb, rb, TM_UNM));
         }
-        continue;
+        vmbreak;
       }
-      case OP_NOT: {
+      vmcase(OP_NOT) {
         int res = l_isfalse(RB(i));  /* next assignment may change this value */
         setbvalue(ra, res);
-        continue;
+        vmbreak;
       }
-      case OP_LEN: {
+      vmcase(OP_LEN) {
         const TValue *rb = RB(i);
         switch (ttype(rb)) {
           case LUA_TTABLE: {
-            setnvalue(ra, cast_num(luaH_getn(hvalue(rb))));
+            setivalue(ra, luaH_getn(hvalue(rb)));
             break;
           }
           case LUA_TSTRING: {
-            setnvalue(ra, cast_num(tsvalue(rb)->len));
+            setivalue(ra, tsvalue(rb)->len);
             break;
           }
           default: {  /* try metamethod */
@@ -529,61 +792,77 @@ void luaV_execute (lua_State *L, int nexeccalls) {
             )
           }
         }
-        continue;
+        jitbreak;
       }
-      case OP_CONCAT: {
+      vmcase(OP_CONCAT) {
         int b = GETARG_B(i);
         int c = GETARG_C(i);
         Protect(luaV_concat(L, c-b+1, c); luaC_checkGC(L));
         setobjs2s(L, RA(i), base+b);
-        continue;
+        jitbreak;
       }
-      case OP_JMP: {
+      vmcase(OP_JMP) {
         dojump(L, pc, GETARG_sBx(i));
-        continue;
+        vmbreak;
       }
-      case OP_EQ: {
+      vmcase(OP_EQ) {
         TValue *rb = RKB(i);
         TValue *rc = RKC(i);
-        Protect(
+        if (ttisnumber(rb) && ttisnumber(rc)) {
+          if (luaO_numeq(rb, rc) == GETARG_A(i))
+            dojump(L, pc, GETARG_sBx(*pc));
+        }
+        else Protect(
           if (equalobj(L, rb, rc) == GETARG_A(i))
             dojump(L, pc, GETARG_sBx(*pc));
         )
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_LT: {
-        Protect(
-          if (luaV_lessthan(L, RKB(i), RKC(i)) == GETARG_A(i))
+      vmcase(OP_LT) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisnumber(rb) && ttisnumber(rc)) {
+          if (numlt(rb, rc) == GETARG_A(i))
+            dojump(L, pc, GETARG_sBx(*pc));
+        }
+        else Protect(
+          if (luaV_lessthan(L, rb, rc) == GETARG_A(i))
             dojump(L, pc, GETARG_sBx(*pc));
         )
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_LE: {
-        Protect(
-          if (lessequal(L, RKB(i), RKC(i)) == GETARG_A(i))
+      vmcase(OP_LE) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisnumber(rb) && ttisnumber(rc)) {
+          if (numle(rb, rc) == GETARG_A(i))
+            dojump(L, pc, GETARG_sBx(*pc));
+        }
+        else Protect(
+          if (luaV_lessequal(L, rb, rc) == GETARG_A(i))
             dojump(L, pc, GETARG_sBx(*pc));
         )
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_TEST: {
+      vmcase(OP_TEST) {
         if (l_isfalse(ra) != GETARG_C(i))
           dojump(L, pc, GETARG_sBx(*pc));
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_TESTSET: {
+      vmcase(OP_TESTSET) {
         TValue *rb = RB(i);
         if (l_isfalse(rb) != GETARG_C(i)) {
           setobjs2s(L, ra, rb);
           dojump(L, pc, GETARG_sBx(*pc));
         }
         pc++;
-        continue;
+        vmbreak;
       }
-      case OP_CALL: {
+      vmcase(OP_CALL) {
         int b = GETARG_B(i);
         int nresults = GETARG_C(i) - 1;
         if (b != 0) L->top = ra+b;  /* else previous instruction set top */
@@ -597,14 +876,14 @@ void luaV_execute (lua_State *L, int nexeccalls) {
             /* it was a C function (`precall' called it); adjust results */
             if (nresults >= 0) L->top = L->ci->top;
             base = L->base;
-            continue;
+            jitbreak;
           }
           default: {
             return;  /* yield */
           }
         }
       }
-      case OP_TAILCALL: {
+      vmcase(OP_TAILCALL) {
         int b = GETARG_B(i);
         if (b != 0) L->top = ra+b;  /* else previous instruction set top */
         L->savedpc = pc;
@@ -629,14 +908,14 @@ void luaV_execute (lua_State *L, int nexeccalls) {
           }
           case PCRC: {  /* it was a C function (`precall' called it) */
             base = L->base;
-            continue;
+            jitbreak;
           }
           default: {
             return;  /* yield */
           }
         }
       }
-      case OP_RETURN: {
+      vmcase(OP_RETURN) {
         int b = GETARG_B(i);
         if (b != 0) L->top = ra+b-1;
         if (L->openupval) luaF_close(L, base);
@@ -651,19 +930,34 @@ void luaV_execute (lua_State *L, int nexeccalls) {
           goto reentry;
         }
       }
-      case OP_FORLOOP: {
-        lua_Number step = nvalue(ra+2);
-        lua_Number idx = luai_numadd(nvalue(ra), step); /* increment index */
-        lua_Number limit = nvalue(ra+1);
-        if (luai_numlt(0, step) ? luai_numle(idx, limit)
-                                : luai_numle(limit, idx)) {
-          dojump(L, pc, GETARG_sBx(i));  /* jump back */
-          setnvalue(ra, idx);  /* update internal index... */
-          setnvalue(ra+3, idx);  /* ...and external index */
+      vmcase(OP_FORLOOP) {
+#if defined(LUAI_INTSUBTYPE)
+        if (ttisint(ra)) {  /* integer loop? (see `OP_FORPREP') */
+          lua_Integer istep = ivalue(ra+2);
+          lua_Integer iidx = ivalue(ra) + istep;  /* increment index */
+          lua_Integer ilimit = ivalue(ra+1);
+          if ((istep > 0) ? iidx <= ilimit : ilimit <= iidx) {
+            setivalue(ra, iidx);  /* update internal index... */
+            setivalue(ra+3, iidx);  /* ...and external index */
+            dojump(L, pc, GETARG_sBx(i));  /* jump back */
+          }
+          vmbreak;
         }
-        continue;
+#endif
+        {
+          lua_Number step = nvalue(ra+2);
+          lua_Number idx = luai_numadd(nvalue(ra), step); /* increment index */
+          lua_Number limit = nvalue(ra+1);
+          if (luai_numlt(0, step) ? luai_numle(idx, limit)
+                                  : luai_numle(limit, idx)) {
+            setnvalue(ra, idx);  /* update internal index... */
+            setnvalue(ra+3, idx);  /* ...and external index */
+            dojump(L, pc, GETARG_sBx(i));  /* jump back */
+          }
+        }
+        vmbreak;
       }
-      case OP_FORPREP: {
+      vmcase(OP_FORPREP) {
         const TValue *init = ra;
         const TValue *plimit = ra+1;
         const TValue *pstep = ra+2;
@@ -674,11 +968,25 @@ void luaV_execute (lua_State *L, int nexeccalls) {
           luaG_runerror(L, LUA_QL("for") " limit must be a number");
         else if (!tonumber(pstep, ra+2))
           luaG_runerror(L, LUA_QL("for") " step must be a number");
+#if defined(LUAI_INTSUBTYPE)
+        if (ttisint(init) && ttisint(pstep) &&
+            numfitsint(cast_num(ivalue(init))) &&
+            numfitsint(cast_num(ivalue(pstep))) && numfitsint(nvalue(plimit))) {
+          /* integer loop; limits keep `OP_FORLOOP' from overflowing */
+          lua_Integer step = ivalue(pstep);
+          lua_Number limit = nvalue(plimit);
+          limit = (step > 0) ? floor(limit) : ceil(limit);
+          setivalue(ra+1, cast(lua_Integer, limit));
+          setivalue(ra, ivalue(init) - step);
+          dojump(L, pc, GETARG_sBx(i));
+          vmbreak;
+        }
+#endif
         setnvalue(ra, luai_numsub(nvalue(ra), nvalue(pstep)));
         dojump(L, pc, GETARG_sBx(i));
-        continue;
+        jitbreak;
       }
-      case OP_TFORLOOP: {
+      vmcase(OP_TFORLOOP) {
         StkId cb = ra + 3;  /* call base */
         setobjs2s(L, cb+2, ra+2);
         setobjs2s(L, cb+1, ra+1);
@@ -692,9 +1000,9 @@ void luaV_execute (lua_State *L, int nexeccalls) {
           dojump(L, pc, GETARG_sBx(*pc));  /* jump back */
         }
         pc++;
-        continue;
+        jitbreak;
       }
-      case OP_SETLIST: {
+      vmcase(OP_SETLIST) {
         int n = GETARG_B(i);
         int c = GETARG_C(i);
         int last;
@@ -714,13 +1022,13 @@ void luaV_execute (lua_State *L, int nexeccalls) {
           setobj2t(L, luaH_setnum(L, h, last--), val);
           luaC_barriert(L, h, val);
         }
-        continue;
+        jitbreak;
       }
-      case OP_CLOSE: {
+      vmcase(OP_CLOSE) {
         luaF_close(L, ra);
-        continue;
+        jitbreak;
       }
-      case OP_CLOSURE: {
+      vmcase(OP_CLOSURE) {
         Proto *p;
         Closure *ncl;
         int nup, j;
@@ -738,9 +1046,9 @@ void luaV_execute (lua_State *L, int nexeccalls) {
         }
         setclvalue(L, ra, ncl);
         Protect(luaC_checkGC(L));
-        continue;
+        jitbreak;
       }
-      case OP_VARARG: {
+      vmcase(OP_VARARG) {
         int b = GETARG_B(i) - 1;
         int j;
         CallInfo *ci = L->ci;
@@ -759,7 +1067,7 @@ void luaV_execute (lua_State *L, int nexeccalls) {
             setnilvalue(ra + j);
           }
         }
-        continue;
+        jitbreak;
       }
     }
   }
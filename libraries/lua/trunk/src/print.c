@@ -109,13 +109,16 @@ static void PrintCode(const Proto* f)
     break;
    case OP_GETUPVAL:
    case OP_SETUPVAL:
+   case OP_GETUINDEX:
     printf("\t; %s", (f->sizeupvalues>0) ? getstr(f->upvalues[b]) : "-");
     break;
    case OP_GETGLOBAL:
    case OP_SETGLOBAL:
+   case OP_GETGINDEX:
     printf("\t; %s",svalue(&f->k[bx]));
     break;
    case OP_GETTABLE:
+   case OP_GETTINDEX:
    case OP_SELF:
     if (ISK(c)) { printf("\t; "); PrintConstant(f,INDEXK(c)); }
     break;
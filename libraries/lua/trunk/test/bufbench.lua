@@ -0,0 +1,56 @@
+-- time of building 100MB strings with table.concat, string.rep, gsub,
+-- string.format and file:read("*a")
+-- usage: lua bufbench.lua [megabytes]
+-- (compare builds with and without LUAL_BUFFERGROW)
+
+local MB = tonumber(arg and arg[1]) or 100
+local SIZE = MB * 2^20
+
+local function run(name, f)
+  collectgarbage()
+  local t0 = os.clock()
+  local s = f()
+  local t = os.clock() - t0
+  assert(#s >= SIZE, name)
+  print(string.format("%-10s %8.3f s  %8.1f MB/s  (%d bytes)", name, t,
+                      #s / 2^20 / t, #s))
+end
+
+local piece = string.rep("0123456789abcdef", 4)  -- 64 bytes
+local pieces = {}
+for i = 1, SIZE / #piece do pieces[i] = piece end
+
+run("concat", function ()
+  return table.concat(pieces)
+end)
+run("concatsep", function ()
+  return table.concat(pieces, ",")
+end)
+pieces = nil
+run("rep", function ()
+  return string.rep("x", SIZE)
+end)
+run("repshort", function ()
+  return string.rep("ab", SIZE / 2)
+end)
+
+local half = string.rep("ab", SIZE / 4)
+run("gsub", function ()
+  return (string.gsub(half, "b", "bbb"))
+end)
+run("format", function ()
+  return string.format("%s%s", half, half)
+end)
+half = nil
+
+local name = os.tmpname()
+local f = assert(io.open(name, "wb"))
+for i = 1, MB do f:write(string.rep(string.char(64 + i % 26), 2^20)) end
+f:close()
+run("read*a", function ()
+  local f = assert(io.open(name, "rb"))
+  local s = f:read("*a")
+  f:close()
+  return s
+end)
+os.remove(name)
@@ -0,0 +1,30 @@
+-- time of some of the test programs, run with their output discarded
+-- usage: lua dispatchbench.lua [scale]
+-- (compare builds with and without LUAI_THREADEDCODE)
+
+local S = tonumber(arg and arg[1]) or 1
+local dir = string.match(arg and arg[0] or "", "^(.-)[^/\\]*$")
+local print, write = print, io.write
+
+local function quiet(f)
+  _G.print, io.write = function () end, function () return io.stdout end
+  local ok, msg = pcall(f)
+  _G.print, io.write = print, write
+  assert(ok, msg)
+end
+
+local function run(name, n, setup)
+  local f = assert(loadfile(dir .. name))
+  n = n * S
+  local t0 = os.clock()
+  for r = 1, n do
+    setup()
+    quiet(f)
+  end
+  print(string.format("%-10s %6d %8.3f s", name, n, os.clock() - t0))
+end
+
+run("fib.lua", 25, function () arg = { "24" } end)
+run("life.lua", 1, function () end)
+run("sort.lua", 10000, function () end)
+run("sieve.lua", 100, function () N = 1000 end)
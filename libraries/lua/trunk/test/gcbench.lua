@@ -0,0 +1,25 @@
+-- time per "request" with a large static heap, in a given collector mode
+-- usage: lua gcbench.lua [incremental|generational] [static-objects] [requests]
+-- (run each mode in its own process, so both start from the same heap)
+
+local mode = arg and arg[1] or "incremental"
+local N = tonumber(arg and arg[2]) or 500000
+local R = tonumber(arg and arg[3]) or 20000
+
+local config = {}
+for i = 1, N do config[i] = { id = i, name = "item" .. i } end
+
+local function request(n)
+  local t = {}
+  for i = 1, 200 do t[i] = { n, i, "field" .. i } end
+  config[(n % N) + 1].last = t[1]   -- old object points to a young one
+  return #t
+end
+
+collectgarbage("collect")
+collectgarbage(mode)
+local t0 = os.clock()
+for n = 1, R do request(n) end
+local dt = os.clock() - t0
+print(string.format("%s: %d static tables, %d requests, %.1f us/request, %d Kb",
+                    mode, N, R, dt / R * 1e6, collectgarbage("count")))
@@ -0,0 +1,46 @@
+-- time of integer-heavy loops
+-- usage: lua intbench.lua [scale]
+-- (compare builds with and without LUAI_INTSUBTYPE)
+
+local S = tonumber(arg and arg[1]) or 1
+
+local function sieve(n)      -- array sieve of Eratosthenes
+  local composite, count = {}, 0
+  for i = 1, n do composite[i] = false end
+  for i = 2, n do
+    if not composite[i] then
+      count = count + 1
+      for j = i * i, n, i do composite[j] = true end
+    end
+  end
+  return count
+end
+
+local function fib(n)        -- iterative fibonacci, modulo a prime
+  local a, b = 0, 1
+  for i = 1, n do a, b = b, (a + b) % 1000003 end
+  return a
+end
+
+local function flags(n)      -- bit flags with arithmetic
+  local set = 0
+  for i = 1, n do
+    local bit = 2 ^ (i % 20)
+    if set % (bit * 2) < bit then set = set + bit else set = set - bit end
+  end
+  return set
+end
+
+local function run(name, f, n)
+  local t0 = os.clock()
+  local r = f(n)
+  print(string.format("%-8s %10d %8.3f s   (%s)", name, n, os.clock() - t0, r))
+end
+
+run("sieve", function(n)
+  local c = 0
+  for r = 1, 10 do c = sieve(n) end
+  return c
+end, 200000 * S)
+run("fib", fib, 5000000 * S)
+run("flags", flags, 2000000 * S)
@@ -0,0 +1,74 @@
+-- time of string.find, match, gmatch and gsub over a synthetic web log,
+-- line by line and as one string
+-- usage: lua patbench.lua [lines]
+-- (compare builds with and without LUAI_PATCOMPILE and LUAI_SSE2FIND)
+
+local N = tonumber(arg and arg[1]) or 50000
+
+math.randomseed(42)
+local methods = {"GET", "GET", "GET", "POST", "PUT", "DELETE"}
+local paths = {"/", "/index.html", "/api/v1/users", "/api/v1/orders",
+               "/static/app.js", "/static/style.css", "/login"}
+local agents = {"Mozilla/5.0 (X11; Linux x86_64)", "curl/7.68.0",
+                "Go-http-client/1.1", "Mozilla/5.0 (Windows NT 10.0)"}
+local log = {}
+for i = 1, N do
+  log[i] = string.format(
+    '10.%d.%d.%d - user%d [17/Oct/2026:12:%02d:%02d +0000] "%s %s?id=%d HTTP/1.1" %d %d "-" "%s" level=%s took=%dms',
+    math.random(0, 255), math.random(0, 255), math.random(0, 255),
+    math.random(100), math.random(0, 59), math.random(0, 59),
+    methods[math.random(#methods)], paths[math.random(#paths)],
+    math.random(1e6), math.random() < 0.9 and 200 or 404,
+    math.random(100, 99999), agents[math.random(#agents)],
+    math.random() < 0.95 and "info" or "error", math.random(1, 999))
+end
+
+local function run(name, f)
+  local t0 = os.clock()
+  local x = 0
+  for i = 1, N do x = x + f(log[i]) end
+  print(string.format("%-10s %8.1f ns/line  (%d)", name,
+                      (os.clock() - t0) / N * 1e9, x))
+end
+
+run("match", function (l)
+  local ip, date, method, path, status, size = string.match(l,
+    '^(%S+) %S+ %S+ %[([^%]]+)%] "(%u+) ([^"]-) HTTP/[%d.]+" (%d+) (%d+)')
+  return ip and #path + status or 0
+end)
+run("find", function (l)
+  return string.find(l, "level=error", 1, false) and 1 or 0
+end)
+run("findcap", function (l)
+  local _, _, ms = string.find(l, "took=(%d+)ms")
+  return tonumber(ms)
+end)
+run("gmatch", function (l)
+  local n = 0
+  for k, v in string.gmatch(l, "(%w+)=(%w+)") do n = n + #v end
+  return n
+end)
+run("gsub", function (l)
+  local s, n = string.gsub(l, "%d+%.%d+%.%d+%.%d+", "x.x.x.x")
+  return n
+end)
+run("frontier", function (l)
+  local _, n = string.gsub(l, "%f[%a]%a+", "")
+  return n
+end)
+
+-- searches over the whole log as one string
+local all = table.concat(log, "\n")
+local function runall(name, p, plain)
+  local t0 = os.clock()
+  local n, i = 0, 1
+  while true do
+    local _, e = string.find(all, p, i, plain)
+    if not e then break end
+    n, i = n + 1, e + 1
+  end
+  print(string.format("%-10s %8.1f us/MB    (%d)", name,
+                      (os.clock() - t0) / #all * 2^20 * 1e6, n))
+end
+runall("findall", '" 404 ', true)
+runall("prefixall", "level=error took=%d+")
@@ -0,0 +1,29 @@
+-- time of full collections that free a 10M-object heap, with and without
+-- background freeing (needs a Lua built with LUA_USE_BGSWEEP)
+-- usage: lua sweepbench.lua [on|off] [objects] [rounds]
+-- (os.clock counts the CPU time of the helper thread too, so on machines
+-- with more than one core also compare the real times given by `time')
+
+local on = (arg and arg[1]) ~= "off"
+local N = tonumber(arg and arg[2]) or 10000000
+local R = tonumber(arg and arg[3]) or 3
+
+if collectgarbage("bgsweep", on and 1 or 0) < 0 then
+  print("background freeing is not available in this build")
+  if on then return end
+end
+
+local cpu, sweep = 0, 0
+for r = 1, R do
+  local t = {}
+  for i = 1, N do t[i] = { i } end
+  t = nil
+  local s0, c0 = collectgarbage("stats").sweep, os.clock()
+  collectgarbage("collect")
+  cpu = cpu + (os.clock() - c0)
+  sweep = sweep + (collectgarbage("stats").sweep - s0)
+end
+collectgarbage("bgsweep", 0)  -- wait for pending frees
+print(string.format("bgsweep %s: %d objects, %.2f s per collection " ..
+                    "(%.2f s sweeping)", on and "on" or "off", N, cpu / R,
+                    sweep / R))
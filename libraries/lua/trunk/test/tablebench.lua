@@ -0,0 +1,42 @@
+-- time of hash lookups (hits and misses) for tables of different sizes
+-- usage: lua tablebench.lua [lookups]
+-- (compare builds with and without LUAI_OPENHASH)
+
+local L = tonumber(arg and arg[1]) or 2000000
+
+local function keys(n, kind, miss)
+  local k = {}
+  for i = 1, n do
+    if kind == "string" then k[i] = (miss and "miss" or "key") .. i
+    else k[i] = (miss and -i or i) + 0.5 end   -- not in the array part
+  end
+  for i = n, 2, -1 do   -- look keys up in random order
+    local j = math.random(i)
+    k[i], k[j] = k[j], k[i]
+  end
+  return k
+end
+
+local function run(t, k)
+  local n, x = #k, 0
+  local t0 = os.clock()
+  for r = 1, L / n do
+    for i = 1, n do
+      if t[k[i]] then x = x + 1 end
+    end
+  end
+  return (os.clock() - t0) / (math.floor(L / n) * n) * 1e9
+end
+
+print(string.format("%8s %8s %10s %10s", "keys", "type", "hit ns", "miss ns"))
+for _, kind in ipairs{"string", "number"} do
+  for _, n in ipairs{8, 64, 512, 4096, 32768, 262144, 1048576} do
+    local hit, miss = keys(n, kind), keys(n, kind, true)
+    local t = {}
+    for i = 1, n do t[hit[i]] = true end
+    print(string.format("%8d %8s %10.1f %10.1f", n, kind,
+                        run(t, hit), run(t, miss)))
+    t, hit, miss = nil
+    collectgarbage()
+  end
+end